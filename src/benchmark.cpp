@@ -0,0 +1,134 @@
+#include <mbed.h>
+#include <cmath>
+#include "gyro.h"
+#include "gesture.h"
+#include "cycle_counter.h"
+#include "benchmark.h"
+
+volatile bool bench_block_done = false;
+
+void OnBenchBlockReady(const Gyroscope_SampleBlock *block)
+{
+    bench_block_done = true;
+}
+
+/*******************************************************************************
+ *
+ * @brief Compare the CPU cycles of a blocking and an asynchronous FIFO burst
+ * The blocking burst keeps the CPU busy for the whole transfer, the asynchronous
+ * one only for starting it; the rest of the transfer time is free for other work
+ *
+ * ****************************************************************************/
+void BenchmarkGyroRead()
+{
+    Gyroscope_RawData samples[FIFO_DEPTH];
+
+    EnableFifoStream(FIFO_DEPTH - 1);
+
+    ThisThread::sleep_for(200ms); // let the FIFO fill up
+    uint32_t start = CycleCounterRead();
+    uint8_t count = ReadFifoBurst(samples, FIFO_DEPTH);
+    uint32_t blocking_cycles = CycleCounterRead() - start;
+
+    // ReadFifoBurst reads the FIFO level itself, so the level read is timed on both paths
+    ThisThread::sleep_for(200ms);
+    bench_block_done = false;
+    start = CycleCounterRead();
+    uint8_t async_count = GetFifoLevel();
+    ReadFifoBurstAsync(async_count, OnBenchBlockReady);
+    uint32_t issue_cycles = CycleCounterRead() - start;
+    while (!bench_block_done)
+    {
+    }
+    uint32_t total_cycles = CycleCounterRead() - start;
+
+    DisableFifoStream();
+
+    printf("[bench] blocking burst: %u samples, %lu cycles CPU busy\r\n", count, (unsigned long)blocking_cycles);
+    printf("[bench] async burst: %u samples, %lu cycles CPU busy, %lu cycles until complete\r\n",
+           async_count, (unsigned long)issue_cycles, (unsigned long)total_cycles);
+}
+
+GestureRecord bench_key;        // synthetic gesture key
+GestureRecord bench_attempt;    // synthetic unlocking attempt
+GestureAxes bench_key_axes;     // bench_key per axis
+GestureAxes bench_attempt_axes; // bench_attempt per axis
+
+/*******************************************************************************
+ *
+ * @brief Float reference of the correlation: samples converted to dps first
+ *
+ * ****************************************************************************/
+float CorrelationFloat(const GestureRecord &a, const GestureRecord &b, int axis)
+{
+    float sum_a = 0, sum_b = 0, sum_ab = 0, sq_sum_a = 0, sq_sum_b = 0;
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        float va = ConvertToDPS(a[i][axis]);
+        float vb = ConvertToDPS(b[i][axis]);
+        sum_a += va;
+        sum_b += vb;
+        sum_ab += va * vb;
+        sq_sum_a += va * va;
+        sq_sum_b += vb * vb;
+    }
+    float n = a.size();
+    return (n * sum_ab - sum_a * sum_b) / sqrtf((n * sq_sum_a - sum_a * sum_a) * (n * sq_sum_b - sum_b * sum_b));
+}
+
+/*******************************************************************************
+ *
+ * @brief Compare the float and the fixed-point correlation in accuracy and cycles
+ *
+ * ****************************************************************************/
+void BenchmarkFixedPoint()
+{
+    FillSyntheticGesture(bench_key, 1, 0.0f);
+    FillSyntheticGesture(bench_attempt, 2, 0.3f);
+
+    array<float, 3> float_result;
+    uint32_t start = CycleCounterRead();
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float_result[axis] = CorrelationFloat(bench_key, bench_attempt, axis);
+    }
+    uint32_t float_cycles = CycleCounterRead() - start;
+
+    // the per-axis copies are made beforehand, only the kernel is timed like the float path
+    to_axes(bench_key_axes, bench_key);
+    to_axes(bench_attempt_axes, bench_attempt);
+    start = CycleCounterRead();
+    array<float, 3> fixed_result = correlation_axes(bench_key_axes, bench_attempt_axes);
+    uint32_t fixed_cycles = CycleCounterRead() - start;
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        printf("[bench] axis %d: float %f, fixed %f, error %e\r\n", axis, float_result[axis], fixed_result[axis],
+               fabsf(float_result[axis] - fixed_result[axis]));
+    }
+    printf("[bench] %u samples: float %lu cycles (%u bytes/sample), fixed %lu cycles (%u bytes/sample)\r\n",
+           (unsigned)bench_key.size(), (unsigned long)float_cycles, (unsigned)sizeof(array<float, 3>),
+           (unsigned long)fixed_cycles, (unsigned)sizeof(GestureSample));
+}
+
+/*******************************************************************************
+ *
+ * @brief Run all benchmarks
+ *
+ * ****************************************************************************/
+void RunBenchmarks()
+{
+    printf("========[Benchmarks]========\r\n");
+    BenchmarkGyroRead();
+    BenchmarkFixedPoint();
+    BenchmarkTemplateSearch();
+    BenchmarkCrossCorrelation();
+    BenchmarkEnrollment();
+    BenchmarkOnlineMatch();
+    BenchmarkQuantizedTemplates();
+    BenchmarkSaxIndex();
+    BenchmarkCachedKeyStats();
+    BenchmarkDspKernels();
+    BenchmarkFilterStages();
+    printf("========[Benchmarks finish.]========\r\n");
+}
@@ -0,0 +1,58 @@
+#ifndef __BENCHMARK_H
+#define __BENCHMARK_H
+
+#include "gesture.h"
+
+// On-target benchmarks, results are printed on the serial port
+// Build with `build_flags = -D BENCHMARK_ENABLE` to run them once the gyroscope is initialized
+
+// Compare the blocking and the asynchronous FIFO burst read
+void BenchmarkGyroRead();
+
+// Compare the float and the fixed-point sample path in accuracy and speed
+void BenchmarkFixedPoint();
+
+// Fill a record with a synthetic gesture in raw counts
+void FillSyntheticGesture(GestureRecord &record, uint32_t seed, float phase);
+
+// Latency of the best-match template search against the number of enrolled templates,
+// returns the key and attempt pairs where LB_Kim or LB_Keogh exceed the DTW distance
+int BenchmarkTemplateSearch();
+
+// FFT cross-correlation against a brute-force Pearson, returns the peaks that differ plus the short attempts that pass
+int BenchmarkCrossCorrelation();
+
+// Fill a record with one performance of a synthetic gesture, or of the impostor's variant
+void FillSyntheticRepetition(GestureRecord &record, uint32_t seed, bool impostor);
+
+// False rejects of a single-recording key and of an averaged key at the same false-accept rate,
+// returns the averaged key's rejects above the limit, plus 1 if averaging did not help
+int BenchmarkEnrollment();
+
+// Online DTW decision against the batch match_templates(), returns the attempts where they pick different keys
+int BenchmarkOnlineMatch();
+
+// Accuracy and speed of the int8 keys against the int16 ones, returns the correlations off by more than the tolerance
+int BenchmarkQuantizedTemplates();
+
+// Candidates of the SAX index and their cost, returns the templates it dropped although they would match
+int BenchmarkSaxIndex();
+
+// Unlocking scan with the key sums cached at enrollment against all sums per key, returns the results that differ
+int BenchmarkCachedKeyStats();
+
+// Check the DSP kernels bit-exact against their scalar references and time both
+int BenchmarkDspKernels();
+
+// Cycles per sample of every filter stage, returns the samples that differ from a direct computation
+int BenchmarkFilterStages();
+
+#ifdef HOST_BUILD
+// SpscRing between a producer and a consumer thread, returns the items lost, repeated or torn
+int BenchmarkSampleRing();
+#endif
+
+// Run all benchmarks
+void RunBenchmarks();
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef __CYCLE_COUNTER_H
+#define __CYCLE_COUNTER_H
+
+#ifndef HOST_BUILD
+#include <mbed.h>
+
+// Start the DWT cycle counter of the Cortex-M4
+inline void CycleCounterInit()
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk; // enable the trace unit
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+// Read the DWT cycle counter, wraps every 2^32 cycles (~24 s at 180 MHz)
+inline uint32_t CycleCounterRead()
+{
+    return DWT->CYCCNT;
+}
+#else
+#include <stdint.h>
+#include <chrono>
+
+// Host build: nothing to start
+inline void CycleCounterInit()
+{
+}
+
+// Host build: nanoseconds of the steady clock instead of cycles
+inline uint32_t CycleCounterRead()
+{
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+#endif
+
+#endif
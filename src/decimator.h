@@ -0,0 +1,96 @@
+#ifndef __DECIMATOR_H
+#define __DECIMATOR_H
+
+#include <stdint.h>
+#include "gyro.h"
+
+#define DECIMATOR_MAX_FACTOR 32 // R^ORDER must stay below 2^31 - 2^16 for the output scaling
+
+// Streaming CIC (cascaded integrator-comb) decimator for the three gyroscope axes
+// Takes every sample at the sensor ODR and emits one sample every `factor` inputs.
+// The integrators run in modular uint32 arithmetic, which is exact for CIC filters as long as
+// the final gain (factor^Order) fits in 32 bits; the output is divided by that gain so it stays in raw units.
+template <int Order = 3>
+class CicDecimator
+{
+public:
+    CicDecimator()
+    {
+        Reset(1);
+    }
+
+    // Clear the filter state and set the decimation factor (1 passes samples through)
+    void Reset(uint8_t decimation_factor)
+    {
+        if (decimation_factor < 1)
+            decimation_factor = 1;
+        if (decimation_factor > DECIMATOR_MAX_FACTOR)
+            decimation_factor = DECIMATOR_MAX_FACTOR;
+        factor = decimation_factor;
+        phase = 0;
+        gain = 1;
+        for (int i = 0; i < Order; i++)
+            gain *= factor;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            for (int i = 0; i < Order; i++)
+            {
+                integrator[axis][i] = 0;
+                comb_delay[axis][i] = 0;
+            }
+        }
+    }
+
+    // Feed one input sample, returns true and fills `out` when an output sample is ready
+    bool Process(const Gyroscope_RawData &in, Gyroscope_RawData &out)
+    {
+        Integrate(0, in.x_raw);
+        Integrate(1, in.y_raw);
+        Integrate(2, in.z_raw);
+
+        if (++phase < factor)
+            return false;
+        phase = 0;
+
+        out.x_raw = Comb(0);
+        out.y_raw = Comb(1);
+        out.z_raw = Comb(2);
+        return true;
+    }
+
+    uint8_t Factor() const
+    {
+        return factor;
+    }
+
+private:
+    void Integrate(int axis, int16_t sample)
+    {
+        uint32_t acc = (uint32_t)(int32_t)sample;
+        for (int i = 0; i < Order; i++)
+        {
+            integrator[axis][i] += acc;
+            acc = integrator[axis][i];
+        }
+    }
+
+    int16_t Comb(int axis)
+    {
+        uint32_t acc = integrator[axis][Order - 1];
+        for (int i = 0; i < Order; i++)
+        {
+            uint32_t delayed = comb_delay[axis][i];
+            comb_delay[axis][i] = acc;
+            acc -= delayed;
+        }
+        return (int16_t)((int32_t)acc / (int32_t)gain);
+    }
+
+    uint32_t integrator[3][Order];
+    uint32_t comb_delay[3][Order];
+    uint32_t gain;
+    uint8_t factor;
+    uint8_t phase;
+};
+
+#endif
@@ -0,0 +1,531 @@
+#ifndef __DSP_KERNELS_H
+#define __DSP_KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// int16 vector kernels of the matcher: dot products, sums of squares and L1/L2 frame costs,
+// and the correlation sums and the dot product of an int8 (q7) template against an int16 (q15) recording
+// Each kernel has a scalar *_ref twin and returns bit-identical results:
+//  - Cortex-M4: dual 16-bit MACs (SMLAD, SMLALD) of the DSP extension, SXTB16 to widen int8 pairs
+//  - x86 host:  PMADDWD with SSE2, or AVX2 when built with -mavx2
+// All sums are exact; int32 results hold for n <= 65536.
+#if defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1) && !defined(HOST_BUILD)
+#include <mbed.h> // CMSIS intrinsics
+#define DSP_KERNELS_M4 1
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define DSP_KERNELS_AVX2 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define DSP_KERNELS_SSE2 1
+#endif
+
+// Sums for the correlation of two equally long int16 arrays
+typedef struct
+{
+    int32_t sum_a;
+    int32_t sum_b;
+    int64_t sum_ab;
+    int64_t sq_sum_a;
+    int64_t sq_sum_b;
+} CorrelationSums;
+
+/*******************************************************************************
+ * Scalar references
+ * ****************************************************************************/
+
+inline int64_t dot_q15_ref(const int16_t *a, const int16_t *b, size_t n)
+{
+    int64_t sum = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        sum += (int32_t)a[i] * b[i];
+    }
+    return sum;
+}
+
+inline int64_t sum_squares_q15_ref(const int16_t *a, size_t n)
+{
+    return dot_q15_ref(a, a, n);
+}
+
+inline void correlation_sums_q15_ref(const int16_t *a, const int16_t *b, size_t n, CorrelationSums &sums)
+{
+    sums.sum_a = 0;
+    sums.sum_b = 0;
+    sums.sum_ab = 0;
+    sums.sq_sum_a = 0;
+    sums.sq_sum_b = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        sums.sum_a += a[i];
+        sums.sum_b += b[i];
+        sums.sum_ab += (int32_t)a[i] * b[i];
+        sums.sq_sum_a += (int32_t)a[i] * a[i];
+        sums.sq_sum_b += (int32_t)b[i] * b[i];
+    }
+}
+
+inline void correlation_sums_q7_q15_ref(const int8_t *a, const int16_t *b, size_t n, CorrelationSums &sums)
+{
+    sums.sum_a = 0;
+    sums.sum_b = 0;
+    sums.sum_ab = 0;
+    sums.sq_sum_a = 0;
+    sums.sq_sum_b = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        sums.sum_a += a[i];
+        sums.sum_b += b[i];
+        sums.sum_ab += (int32_t)a[i] * b[i];
+        sums.sq_sum_a += (int32_t)a[i] * a[i];
+        sums.sq_sum_b += (int32_t)b[i] * b[i];
+    }
+}
+
+inline int64_t dot_q7_q15_ref(const int8_t *a, const int16_t *b, size_t n)
+{
+    int64_t sum = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        sum += (int32_t)a[i] * b[i];
+    }
+    return sum;
+}
+
+inline uint32_t frame_cost_l1_ref(const int16_t *a, const int16_t *b, size_t n)
+{
+    uint32_t sum = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        int32_t d = (int32_t)a[i] - b[i];
+        sum += d < 0 ? -d : d;
+    }
+    return sum;
+}
+
+inline uint64_t frame_cost_l2_ref(const int16_t *a, const int16_t *b, size_t n)
+{
+    uint64_t sum = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        int32_t d = (int32_t)a[i] - b[i];
+        uint32_t magnitude = d < 0 ? -d : d;
+        sum += magnitude * magnitude; // up to (2^16 - 1)^2, only fits unsigned
+    }
+    return sum;
+}
+
+/*******************************************************************************
+ * Vector helpers
+ * ****************************************************************************/
+
+#if defined(DSP_KERNELS_M4)
+// two int16 lanes packed in one word, the M4 handles the unaligned load
+inline uint32_t load_q15x2(const int16_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+#elif defined(DSP_KERNELS_AVX2)
+// PMADDWD wraps a lane to INT32_MIN only for (-32768)^2 + (-32768)^2 = 2^31, count those
+// lanes and sign-extend the rest to 64 bit; the caller adds 2^32 for every counted lane
+inline void madd_accumulate(__m256i m, __m256i &acc, __m256i &wraps)
+{
+    wraps = _mm256_sub_epi32(wraps, _mm256_cmpeq_epi32(m, _mm256_set1_epi32(INT32_MIN)));
+    acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(m)));
+    acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(m, 1)));
+}
+
+inline int64_t madd_reduce(__m256i acc, __m256i wraps)
+{
+    int64_t lanes[4];
+    int32_t counts[8];
+    _mm256_storeu_si256((__m256i *)lanes, acc);
+    _mm256_storeu_si256((__m256i *)counts, wraps);
+    int64_t wrap_count = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        wrap_count += counts[i];
+    }
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + (wrap_count << 32);
+}
+#elif defined(DSP_KERNELS_SSE2)
+// PMADDWD wraps a lane to INT32_MIN only for (-32768)^2 + (-32768)^2 = 2^31, count those
+// lanes and sign-extend the rest to 64 bit; the caller adds 2^32 for every counted lane
+inline void madd_accumulate(__m128i m, __m128i &acc, __m128i &wraps)
+{
+    wraps = _mm_sub_epi32(wraps, _mm_cmpeq_epi32(m, _mm_set1_epi32(INT32_MIN)));
+    __m128i sign = _mm_srai_epi32(m, 31);
+    acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(m, sign));
+    acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(m, sign));
+}
+
+inline int64_t madd_reduce(__m128i acc, __m128i wraps)
+{
+    int64_t lanes[2];
+    int32_t counts[4];
+    _mm_storeu_si128((__m128i *)lanes, acc);
+    _mm_storeu_si128((__m128i *)counts, wraps);
+    int64_t wrap_count = (int64_t)counts[0] + counts[1] + counts[2] + counts[3];
+    return lanes[0] + lanes[1] + (wrap_count << 32);
+}
+#endif
+
+/*******************************************************************************
+ * Kernels
+ * ****************************************************************************/
+
+// sum of a[i] * b[i]
+inline int64_t dot_q15(const int16_t *a, const int16_t *b, size_t n)
+{
+    size_t i = 0;
+    int64_t sum = 0;
+#if defined(DSP_KERNELS_M4)
+    uint64_t acc = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        acc = __SMLALD(load_q15x2(a + i), load_q15x2(b + i), acc);
+    }
+    sum = (int64_t)acc;
+#elif defined(DSP_KERNELS_AVX2)
+    __m256i acc = _mm256_setzero_si256(), wraps = _mm256_setzero_si256();
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+        madd_accumulate(_mm256_madd_epi16(va, vb), acc, wraps);
+    }
+    sum = madd_reduce(acc, wraps);
+#elif defined(DSP_KERNELS_SSE2)
+    __m128i acc = _mm_setzero_si128(), wraps = _mm_setzero_si128();
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+        madd_accumulate(_mm_madd_epi16(va, vb), acc, wraps);
+    }
+    sum = madd_reduce(acc, wraps);
+#endif
+    return sum + dot_q15_ref(a + i, b + i, n - i);
+}
+
+// sum of a[i]^2
+inline int64_t sum_squares_q15(const int16_t *a, size_t n)
+{
+    return dot_q15(a, a, n);
+}
+
+// the five correlation sums in one pass
+inline void correlation_sums_q15(const int16_t *a, const int16_t *b, size_t n, CorrelationSums &sums)
+{
+#if defined(DSP_KERNELS_M4)
+    size_t i = 0;
+    int32_t sum_a = 0, sum_b = 0;
+    uint64_t sum_ab = 0, sq_sum_a = 0, sq_sum_b = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        uint32_t va = load_q15x2(a + i);
+        uint32_t vb = load_q15x2(b + i);
+        sum_a = __SMLAD(va, 0x00010001, sum_a); // a0 * 1 + a1 * 1
+        sum_b = __SMLAD(vb, 0x00010001, sum_b);
+        sum_ab = __SMLALD(va, vb, sum_ab);
+        sq_sum_a = __SMLALD(va, va, sq_sum_a);
+        sq_sum_b = __SMLALD(vb, vb, sq_sum_b);
+    }
+    correlation_sums_q15_ref(a + i, b + i, n - i, sums);
+    sums.sum_a += sum_a;
+    sums.sum_b += sum_b;
+    sums.sum_ab += (int64_t)sum_ab;
+    sums.sq_sum_a += (int64_t)sq_sum_a;
+    sums.sq_sum_b += (int64_t)sq_sum_b;
+#elif defined(DSP_KERNELS_AVX2)
+    size_t i = 0;
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i sum_a = _mm256_setzero_si256(), sum_b = _mm256_setzero_si256();
+    __m256i sum_ab = _mm256_setzero_si256(), sq_sum_a = _mm256_setzero_si256(), sq_sum_b = _mm256_setzero_si256();
+    __m256i wraps_ab = _mm256_setzero_si256(), wraps_a = _mm256_setzero_si256(), wraps_b = _mm256_setzero_si256();
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+        sum_a = _mm256_add_epi32(sum_a, _mm256_madd_epi16(va, ones));
+        sum_b = _mm256_add_epi32(sum_b, _mm256_madd_epi16(vb, ones));
+        madd_accumulate(_mm256_madd_epi16(va, vb), sum_ab, wraps_ab);
+        madd_accumulate(_mm256_madd_epi16(va, va), sq_sum_a, wraps_a);
+        madd_accumulate(_mm256_madd_epi16(vb, vb), sq_sum_b, wraps_b);
+    }
+    correlation_sums_q15_ref(a + i, b + i, n - i, sums);
+    int32_t lanes[8];
+    _mm256_storeu_si256((__m256i *)lanes, sum_a);
+    for (int k = 0; k < 8; k++)
+    {
+        sums.sum_a += lanes[k];
+    }
+    _mm256_storeu_si256((__m256i *)lanes, sum_b);
+    for (int k = 0; k < 8; k++)
+    {
+        sums.sum_b += lanes[k];
+    }
+    sums.sum_ab += madd_reduce(sum_ab, wraps_ab);
+    sums.sq_sum_a += madd_reduce(sq_sum_a, wraps_a);
+    sums.sq_sum_b += madd_reduce(sq_sum_b, wraps_b);
+#elif defined(DSP_KERNELS_SSE2)
+    size_t i = 0;
+    const __m128i ones = _mm_set1_epi16(1);
+    __m128i sum_a = _mm_setzero_si128(), sum_b = _mm_setzero_si128();
+    __m128i sum_ab = _mm_setzero_si128(), sq_sum_a = _mm_setzero_si128(), sq_sum_b = _mm_setzero_si128();
+    __m128i wraps_ab = _mm_setzero_si128(), wraps_a = _mm_setzero_si128(), wraps_b = _mm_setzero_si128();
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+        sum_a = _mm_add_epi32(sum_a, _mm_madd_epi16(va, ones));
+        sum_b = _mm_add_epi32(sum_b, _mm_madd_epi16(vb, ones));
+        madd_accumulate(_mm_madd_epi16(va, vb), sum_ab, wraps_ab);
+        madd_accumulate(_mm_madd_epi16(va, va), sq_sum_a, wraps_a);
+        madd_accumulate(_mm_madd_epi16(vb, vb), sq_sum_b, wraps_b);
+    }
+    correlation_sums_q15_ref(a + i, b + i, n - i, sums);
+    int32_t lanes[4];
+    _mm_storeu_si128((__m128i *)lanes, sum_a);
+    sums.sum_a += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    _mm_storeu_si128((__m128i *)lanes, sum_b);
+    sums.sum_b += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    sums.sum_ab += madd_reduce(sum_ab, wraps_ab);
+    sums.sq_sum_a += madd_reduce(sq_sum_a, wraps_a);
+    sums.sq_sum_b += madd_reduce(sq_sum_b, wraps_b);
+#else
+    correlation_sums_q15_ref(a, b, n, sums);
+#endif
+}
+
+// the five correlation sums of an int8 template a against an int16 recording b in one pass
+// Half the template bytes of correlation_sums_q15; the sums of a and a^2 stay in 32-bit lanes
+inline void correlation_sums_q7_q15(const int8_t *a, const int16_t *b, size_t n, CorrelationSums &sums)
+{
+#if defined(DSP_KERNELS_M4)
+    size_t i = 0;
+    int32_t sum_a = 0, sum_b = 0, sq_sum_a = 0;
+    uint64_t sum_ab = 0, sq_sum_b = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        uint32_t va;
+        memcpy(&va, a + i, sizeof(va));
+        uint32_t va02 = __SXTB16(va);          // a0, a2
+        uint32_t va13 = __SXTB16(__ROR(va, 8)); // a1, a3
+        uint32_t vb01 = load_q15x2(b + i);
+        uint32_t vb23 = load_q15x2(b + i + 2);
+        uint32_t vb02 = __PKHBT(vb01, vb23, 16); // b0, b2
+        uint32_t vb13 = __PKHTB(vb23, vb01, 16); // b1, b3
+        sum_a = __SMLAD(va02, 0x00010001, __SMLAD(va13, 0x00010001, sum_a));
+        sum_b = __SMLAD(vb01, 0x00010001, __SMLAD(vb23, 0x00010001, sum_b));
+        sq_sum_a = __SMLAD(va02, va02, __SMLAD(va13, va13, sq_sum_a)); // at most 2^15 per sample
+        sum_ab = __SMLALD(va13, vb13, __SMLALD(va02, vb02, sum_ab));
+        sq_sum_b = __SMLALD(vb23, vb23, __SMLALD(vb01, vb01, sq_sum_b));
+    }
+    correlation_sums_q7_q15_ref(a + i, b + i, n - i, sums);
+    sums.sum_a += sum_a;
+    sums.sum_b += sum_b;
+    sums.sum_ab += (int64_t)sum_ab;
+    sums.sq_sum_a += sq_sum_a;
+    sums.sq_sum_b += (int64_t)sq_sum_b;
+#elif defined(DSP_KERNELS_AVX2)
+    size_t i = 0;
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i sum_a = _mm256_setzero_si256(), sum_b = _mm256_setzero_si256(), sq_sum_a = _mm256_setzero_si256();
+    __m256i sum_ab = _mm256_setzero_si256(), sq_sum_b = _mm256_setzero_si256();
+    __m256i wraps_ab = _mm256_setzero_si256(), wraps_b = _mm256_setzero_si256();
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i va = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(a + i)));
+        __m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+        sum_a = _mm256_add_epi32(sum_a, _mm256_madd_epi16(va, ones));
+        sum_b = _mm256_add_epi32(sum_b, _mm256_madd_epi16(vb, ones));
+        sq_sum_a = _mm256_add_epi32(sq_sum_a, _mm256_madd_epi16(va, va));
+        madd_accumulate(_mm256_madd_epi16(va, vb), sum_ab, wraps_ab);
+        madd_accumulate(_mm256_madd_epi16(vb, vb), sq_sum_b, wraps_b);
+    }
+    correlation_sums_q7_q15_ref(a + i, b + i, n - i, sums);
+    int32_t lanes[3][8];
+    _mm256_storeu_si256((__m256i *)lanes[0], sum_a);
+    _mm256_storeu_si256((__m256i *)lanes[1], sum_b);
+    _mm256_storeu_si256((__m256i *)lanes[2], sq_sum_a);
+    for (int k = 0; k < 8; k++)
+    {
+        sums.sum_a += lanes[0][k];
+        sums.sum_b += lanes[1][k];
+        sums.sq_sum_a += lanes[2][k];
+    }
+    sums.sum_ab += madd_reduce(sum_ab, wraps_ab);
+    sums.sq_sum_b += madd_reduce(sq_sum_b, wraps_b);
+#elif defined(DSP_KERNELS_SSE2)
+    size_t i = 0;
+    const __m128i ones = _mm_set1_epi16(1);
+    __m128i sum_a = _mm_setzero_si128(), sum_b = _mm_setzero_si128(), sq_sum_a = _mm_setzero_si128();
+    __m128i sum_ab = _mm_setzero_si128(), sq_sum_b = _mm_setzero_si128();
+    __m128i wraps_ab = _mm_setzero_si128(), wraps_b = _mm_setzero_si128();
+    for (; i + 8 <= n; i += 8)
+    {
+        // sign-extend the 8 bytes to 16 bit by unpacking into the high byte and shifting back
+        __m128i va = _mm_loadl_epi64((const __m128i *)(a + i));
+        va = _mm_srai_epi16(_mm_unpacklo_epi8(va, va), 8);
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+        sum_a = _mm_add_epi32(sum_a, _mm_madd_epi16(va, ones));
+        sum_b = _mm_add_epi32(sum_b, _mm_madd_epi16(vb, ones));
+        sq_sum_a = _mm_add_epi32(sq_sum_a, _mm_madd_epi16(va, va));
+        madd_accumulate(_mm_madd_epi16(va, vb), sum_ab, wraps_ab);
+        madd_accumulate(_mm_madd_epi16(vb, vb), sq_sum_b, wraps_b);
+    }
+    correlation_sums_q7_q15_ref(a + i, b + i, n - i, sums);
+    int32_t lanes[4];
+    _mm_storeu_si128((__m128i *)lanes, sum_a);
+    sums.sum_a += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    _mm_storeu_si128((__m128i *)lanes, sum_b);
+    sums.sum_b += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    _mm_storeu_si128((__m128i *)lanes, sq_sum_a);
+    sums.sq_sum_a += (int64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    sums.sum_ab += madd_reduce(sum_ab, wraps_ab);
+    sums.sq_sum_b += madd_reduce(sq_sum_b, wraps_b);
+#else
+    correlation_sums_q7_q15_ref(a, b, n, sums);
+#endif
+}
+
+// sum of a[i] * b[i] for an int8 template a and an int16 recording b
+// The cross term of correlation_sums_q7_q15 alone, for a template whose own sums are cached
+inline int64_t dot_q7_q15(const int8_t *a, const int16_t *b, size_t n)
+{
+    size_t i = 0;
+    int64_t sum = 0;
+#if defined(DSP_KERNELS_M4)
+    uint64_t acc = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        uint32_t va;
+        memcpy(&va, a + i, sizeof(va));
+        uint32_t vb01 = load_q15x2(b + i);
+        uint32_t vb23 = load_q15x2(b + i + 2);
+        acc = __SMLALD(__SXTB16(va), __PKHBT(vb01, vb23, 16), acc);            // a0 b0 + a2 b2
+        acc = __SMLALD(__SXTB16(__ROR(va, 8)), __PKHTB(vb23, vb01, 16), acc); // a1 b1 + a3 b3
+    }
+    sum = (int64_t)acc;
+#elif defined(DSP_KERNELS_AVX2)
+    __m256i acc = _mm256_setzero_si256(), wraps = _mm256_setzero_si256();
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i va = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(a + i)));
+        __m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+        madd_accumulate(_mm256_madd_epi16(va, vb), acc, wraps);
+    }
+    sum = madd_reduce(acc, wraps);
+#elif defined(DSP_KERNELS_SSE2)
+    __m128i acc = _mm_setzero_si128(), wraps = _mm_setzero_si128();
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i va = _mm_loadl_epi64((const __m128i *)(a + i));
+        va = _mm_srai_epi16(_mm_unpacklo_epi8(va, va), 8);
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+        madd_accumulate(_mm_madd_epi16(va, vb), acc, wraps);
+    }
+    sum = madd_reduce(acc, wraps);
+#endif
+    return sum + dot_q7_q15_ref(a + i, b + i, n - i);
+}
+
+// sum of |a[i] - b[i]|
+// The M4 has no exact 16-bit absolute difference (SSUB16 wraps, QSUB16 saturates), so it
+// takes the scalar path; the host widens to 32-bit lanes first
+inline uint32_t frame_cost_l1(const int16_t *a, const int16_t *b, size_t n)
+{
+    size_t i = 0;
+    uint32_t sum = 0;
+#if defined(DSP_KERNELS_AVX2)
+    __m256i acc = _mm256_setzero_si256();
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i va = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(a + i)));
+        __m256i vb = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(b + i)));
+        acc = _mm256_add_epi32(acc, _mm256_abs_epi32(_mm256_sub_epi32(va, vb)));
+    }
+    uint32_t lanes[8];
+    _mm256_storeu_si256((__m256i *)lanes, acc);
+    for (int k = 0; k < 8; k++)
+    {
+        sum += lanes[k];
+    }
+#elif defined(DSP_KERNELS_SSE2)
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+        // sign-extend to 32 bit by unpacking into the high half and shifting back
+        __m128i d_lo = _mm_sub_epi32(_mm_srai_epi32(_mm_unpacklo_epi16(va, va), 16), _mm_srai_epi32(_mm_unpacklo_epi16(vb, vb), 16));
+        __m128i d_hi = _mm_sub_epi32(_mm_srai_epi32(_mm_unpackhi_epi16(va, va), 16), _mm_srai_epi32(_mm_unpackhi_epi16(vb, vb), 16));
+        __m128i s_lo = _mm_srai_epi32(d_lo, 31);
+        __m128i s_hi = _mm_srai_epi32(d_hi, 31);
+        acc = _mm_add_epi32(acc, _mm_sub_epi32(_mm_xor_si128(d_lo, s_lo), s_lo)); // |d| without SSSE3
+        acc = _mm_add_epi32(acc, _mm_sub_epi32(_mm_xor_si128(d_hi, s_hi), s_hi));
+    }
+    uint32_t lanes[4];
+    _mm_storeu_si128((__m128i *)lanes, acc);
+    sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+    return sum + frame_cost_l1_ref(a + i, b + i, n - i);
+}
+
+// sum of (a[i] - b[i])^2
+// A 16-bit difference needs 17 bits, so the packed kernels expand it as a^2 + b^2 - 2ab
+inline uint64_t frame_cost_l2(const int16_t *a, const int16_t *b, size_t n)
+{
+#if defined(DSP_KERNELS_M4)
+    size_t i = 0;
+    uint64_t sq_sum_a = 0, sq_sum_b = 0, sum_ab = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        uint32_t va = load_q15x2(a + i);
+        uint32_t vb = load_q15x2(b + i);
+        sq_sum_a = __SMLALD(va, va, sq_sum_a);
+        sq_sum_b = __SMLALD(vb, vb, sq_sum_b);
+        sum_ab = __SMLALD(va, vb, sum_ab);
+    }
+    int64_t sum = (int64_t)sq_sum_a + (int64_t)sq_sum_b - 2 * (int64_t)sum_ab;
+    return (uint64_t)sum + frame_cost_l2_ref(a + i, b + i, n - i);
+#elif defined(DSP_KERNELS_AVX2)
+    size_t i = 0;
+    __m256i sq_sum = _mm256_setzero_si256(), sum_ab = _mm256_setzero_si256();
+    __m256i wraps_sq = _mm256_setzero_si256(), wraps_ab = _mm256_setzero_si256();
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+        madd_accumulate(_mm256_madd_epi16(va, va), sq_sum, wraps_sq);
+        madd_accumulate(_mm256_madd_epi16(vb, vb), sq_sum, wraps_sq);
+        madd_accumulate(_mm256_madd_epi16(va, vb), sum_ab, wraps_ab);
+    }
+    int64_t sum = madd_reduce(sq_sum, wraps_sq) - 2 * madd_reduce(sum_ab, wraps_ab);
+    return (uint64_t)sum + frame_cost_l2_ref(a + i, b + i, n - i);
+#elif defined(DSP_KERNELS_SSE2)
+    size_t i = 0;
+    __m128i sq_sum = _mm_setzero_si128(), sum_ab = _mm_setzero_si128();
+    __m128i wraps_sq = _mm_setzero_si128(), wraps_ab = _mm_setzero_si128();
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+        madd_accumulate(_mm_madd_epi16(va, va), sq_sum, wraps_sq);
+        madd_accumulate(_mm_madd_epi16(vb, vb), sq_sum, wraps_sq);
+        madd_accumulate(_mm_madd_epi16(va, vb), sum_ab, wraps_ab);
+    }
+    int64_t sum = madd_reduce(sq_sum, wraps_sq) - 2 * madd_reduce(sum_ab, wraps_ab);
+    return (uint64_t)sum + frame_cost_l2_ref(a + i, b + i, n - i);
+#else
+    return frame_cost_l2_ref(a, b, n);
+#endif
+}
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef __ENDPOINT_DETECTOR_H
+#define __ENDPOINT_DETECTOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "gesture.h"
+
+#define ENDPOINT_MAX_WINDOW 16 // longest short-term energy window in samples
+
+// Streaming gesture endpoint detector, in the manner of a speech VAD
+// Tracks the short-term energy (mean of x^2 + y^2 + z^2 over the last `window` samples) and opens
+// the gesture once it rises above the open threshold. It closes again after the energy stayed
+// below the lower close threshold for `hangover` samples; the gap between the two thresholds
+// keeps a gesture that briefly slows down from being cut in two.
+class EndpointDetector
+{
+public:
+    enum State
+    {
+        IDLE,   // waiting for the gesture to start
+        ACTIVE, // gesture in progress
+        CLOSED  // gesture finished, stays closed until Reset
+    };
+
+    EndpointDetector()
+    {
+        Reset(1000, 500, 4, 20);
+    }
+
+    // Clear the state and set the thresholds as RMS rates in raw counts, the window and the hangover in samples
+    void Reset(uint16_t open_rms, uint16_t close_rms, uint8_t window_length, uint16_t hangover_length)
+    {
+        if (window_length < 1)
+            window_length = 1;
+        if (window_length > ENDPOINT_MAX_WINDOW)
+            window_length = ENDPOINT_MAX_WINDOW;
+        open_energy = (uint64_t)open_rms * open_rms * window_length;
+        close_energy = (uint64_t)close_rms * close_rms * window_length;
+        window = window_length;
+        hangover = hangover_length;
+        state = IDLE;
+        energy = 0;
+        position = 0;
+        quiet = 0;
+        count = 0;
+        open_index = 0;
+        close_index = 0;
+        for (int i = 0; i < ENDPOINT_MAX_WINDOW; i++)
+            history[i] = 0;
+    }
+
+    // Feed one sample, returns the state after it
+    State Process(const GestureSample &sample)
+    {
+        uint32_t frame = 0;
+        for (int axis = 0; axis < 3; axis++)
+            frame += (uint32_t)((int32_t)sample[axis] * sample[axis]); // at most 3 * 2^30, fits
+        energy += frame;
+        energy -= history[position];
+        history[position] = frame;
+        position = (position + 1) % window;
+        count++;
+
+        if (state == IDLE && energy >= open_energy)
+        {
+            state = ACTIVE;
+            open_index = count > window ? count - window : 0; // the window that crossed started here
+            quiet = 0;
+        }
+        else if (state == ACTIVE)
+        {
+            quiet = energy < close_energy ? quiet + 1 : 0;
+            if (quiet >= hangover)
+            {
+                state = CLOSED;
+                close_index = count;
+            }
+        }
+        return state;
+    }
+
+    State GetState() const
+    {
+        return state;
+    }
+
+    // Index of the first sample of the window that opened the gesture
+    size_t OpenIndex() const
+    {
+        return open_index;
+    }
+
+    // Number of samples seen when the gesture closed
+    size_t CloseIndex() const
+    {
+        return close_index;
+    }
+
+private:
+    uint32_t history[ENDPOINT_MAX_WINDOW]; // frame energies of the window
+    uint64_t energy;                       // sum of the window
+    uint64_t open_energy;                  // window sums at the thresholds
+    uint64_t close_energy;
+    size_t count;
+    size_t open_index;
+    size_t close_index;
+    uint16_t hangover;
+    uint16_t quiet;
+    uint8_t window;
+    uint8_t position;
+    State state;
+};
+
+#endif
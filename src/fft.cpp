@@ -0,0 +1,166 @@
+#include <math.h>
+#include "fft.h"
+
+float fft_cos[FFT_MAX_SIZE / 2]; // cos(2 pi k / FFT_MAX_SIZE), filled on first use
+float fft_sin[FFT_MAX_SIZE / 2]; // sin(2 pi k / FFT_MAX_SIZE)
+bool fft_table_ready = false;
+
+/*******************************************************************************
+ *
+ * @brief Fill the twiddle table once, every transform size indexes into it with a stride
+ *
+ * ****************************************************************************/
+void fft_init_table()
+{
+    for (size_t k = 0; k < FFT_MAX_SIZE / 2; ++k)
+    {
+        fft_cos[k] = cosf(2.0f * (float)M_PI * k / FFT_MAX_SIZE);
+        fft_sin[k] = sinf(2.0f * (float)M_PI * k / FFT_MAX_SIZE);
+    }
+    fft_table_ready = true;
+}
+
+/*******************************************************************************
+ *
+ * @brief In-place iterative radix-2 FFT of m interleaved complex values
+ * @param data: re, im pairs
+ * @param m: number of complex values, a power of two
+ * @param inverse: use e^(+i) twiddles, without scaling
+ *
+ * ****************************************************************************/
+void fft_complex(float *data, size_t m, bool inverse)
+{
+    // bit-reversal permutation
+    for (size_t i = 1, j = 0; i < m; ++i)
+    {
+        size_t bit = m >> 1;
+        for (; j & bit; bit >>= 1)
+        {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j)
+        {
+            float re = data[2 * i], im = data[2 * i + 1];
+            data[2 * i] = data[2 * j];
+            data[2 * i + 1] = data[2 * j + 1];
+            data[2 * j] = re;
+            data[2 * j + 1] = im;
+        }
+    }
+
+    // butterflies
+    for (size_t len = 2; len <= m; len <<= 1)
+    {
+        size_t stride = FFT_MAX_SIZE / len;
+        for (size_t start = 0; start < m; start += len)
+        {
+            for (size_t k = 0; k < len / 2; ++k)
+            {
+                float wr = fft_cos[k * stride];
+                float wi = inverse ? fft_sin[k * stride] : -fft_sin[k * stride];
+                float *a = data + 2 * (start + k);
+                float *b = data + 2 * (start + k + len / 2);
+                float tr = wr * b[0] - wi * b[1];
+                float ti = wr * b[1] + wi * b[0];
+                b[0] = a[0] - tr;
+                b[1] = a[1] - ti;
+                a[0] += tr;
+                a[1] += ti;
+            }
+        }
+    }
+}
+
+/*******************************************************************************
+ *
+ * @brief In-place FFT of n real samples through one complex FFT of n/2 points
+ * The even and odd samples form the real and imaginary parts, their spectra are
+ * separated and merged with the twiddles e^(-2 pi i k/n) afterwards
+ * @param data: n real samples in, the packed spectrum out (see fft.h)
+ * @param n: number of samples, a power of two between 4 and FFT_MAX_SIZE
+ *
+ * ****************************************************************************/
+void fft_real(float *data, size_t n)
+{
+    if (!fft_table_ready)
+    {
+        fft_init_table();
+    }
+    size_t m = n / 2;
+    size_t stride = FFT_MAX_SIZE / n;
+
+    fft_complex(data, m, false);
+
+    // DC and Nyquist are real, they share the first pair
+    float z0r = data[0], z0i = data[1];
+    data[0] = z0r + z0i;
+    data[1] = z0r - z0i;
+
+    // X[k] = Fe + W^k Fo and X[m-k] = conj(Fe - W^k Fo), with Fe, Fo the even and odd spectra
+    for (size_t k = 1; k <= m / 2; ++k)
+    {
+        float *zk = data + 2 * k;
+        float *zm = data + 2 * (m - k);
+        float fe_r = 0.5f * (zk[0] + zm[0]);
+        float fe_i = 0.5f * (zk[1] - zm[1]);
+        float fo_r = 0.5f * (zk[1] + zm[1]);
+        float fo_i = -0.5f * (zk[0] - zm[0]);
+        float wr = fft_cos[k * stride];
+        float wi = -fft_sin[k * stride];
+        float tr = wr * fo_r - wi * fo_i;
+        float ti = wr * fo_i + wi * fo_r;
+        zk[0] = fe_r + tr;
+        zk[1] = fe_i + ti;
+        zm[0] = fe_r - tr;
+        zm[1] = -(fe_i - ti);
+    }
+}
+
+/*******************************************************************************
+ *
+ * @brief Inverse of fft_real, including the 1/n scaling
+ * @param data: the packed spectrum in, n real samples out
+ * @param n: number of samples, a power of two between 4 and FFT_MAX_SIZE
+ *
+ * ****************************************************************************/
+void ifft_real(float *data, size_t n)
+{
+    if (!fft_table_ready)
+    {
+        fft_init_table();
+    }
+    size_t m = n / 2;
+    size_t stride = FFT_MAX_SIZE / n;
+
+    // undo the merge: Fe = (X[k] + conj X[m-k]) / 2, Fo = conj(W^k) (X[k] - conj X[m-k]) / 2, Z = Fe + i Fo
+    float x0 = data[0], xm = data[1];
+    data[0] = 0.5f * (x0 + xm);
+    data[1] = 0.5f * (x0 - xm);
+
+    for (size_t k = 1; k <= m / 2; ++k)
+    {
+        float *xk = data + 2 * k;
+        float *xmk = data + 2 * (m - k);
+        float fe_r = 0.5f * (xk[0] + xmk[0]);
+        float fe_i = 0.5f * (xk[1] - xmk[1]);
+        float dr = 0.5f * (xk[0] - xmk[0]);
+        float di = 0.5f * (xk[1] + xmk[1]);
+        float wr = fft_cos[k * stride];
+        float wi = fft_sin[k * stride]; // conjugate twiddle
+        float fo_r = wr * dr - wi * di;
+        float fo_i = wr * di + wi * dr;
+        xk[0] = fe_r - fo_i;
+        xk[1] = fe_i + fo_r;
+        xmk[0] = fe_r + fo_i; // Z[m-k] = conj(Fe) + i conj(Fo)
+        xmk[1] = -fe_i + fo_r;
+    }
+
+    fft_complex(data, m, true);
+
+    float scale = 1.0f / m;
+    for (size_t i = 0; i < n; ++i)
+    {
+        data[i] *= scale;
+    }
+}
@@ -0,0 +1,17 @@
+#ifndef __FFT_H
+#define __FFT_H
+
+#include <stddef.h>
+
+// Largest transform, a power of two; 512 holds the linear correlation of two full recordings
+#define FFT_MAX_SIZE 512
+
+// In-place radix-2 FFT of n real samples, n a power of two between 4 and FFT_MAX_SIZE
+// The spectrum is packed into the same n floats: data[0] = X[0], data[1] = X[n/2] (both real),
+// then data[2k], data[2k+1] = Re X[k], Im X[k] for 0 < k < n/2, with X[k] = sum x[j] e^(-2 pi i jk/n)
+void fft_real(float *data, size_t n);
+
+// Inverse of fft_real, including the 1/n scaling
+void ifft_real(float *data, size_t n);
+
+#endif
@@ -0,0 +1,286 @@
+#ifndef __FILTER_STAGES_H
+#define __FILTER_STAGES_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+#include "gesture.h"
+
+// Streaming filter stages for the three axes of a GestureSample
+// Every stage is configured by its template arguments, keeps a fixed-size state and has
+//   void Reset();                                   // back to a zero history
+//   GestureSample Process(const GestureSample &in); // one sample in, one sample out
+// so stages can be chained with FilterChain<...>. Everything stays in integers except the
+// biquad coefficients, which are computed once at construction.
+
+// Saturate an intermediate result to a raw count
+inline int16_t filter_saturate(int64_t value)
+{
+    return (int16_t)(value > INT16_MAX ? INT16_MAX : value < -INT16_MAX ? -INT16_MAX : value);
+}
+
+// Division rounded to nearest, halves away from zero
+inline int32_t filter_divide(int32_t value, int32_t divisor)
+{
+    return value >= 0 ? (value + divisor / 2) / divisor : -((-value + divisor / 2) / divisor);
+}
+
+// Moving average of the last N samples, O(1) per sample from a running sum
+template <size_t N>
+class MovingAverage
+{
+    static_assert(N >= 1 && N <= 65536, "the running sum of N int16 values has to fit in 32 bits");
+
+public:
+    MovingAverage()
+    {
+        Reset();
+    }
+
+    void Reset()
+    {
+        position = 0;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            sum[axis] = 0;
+            for (size_t i = 0; i < N; i++)
+                history[i][axis] = 0;
+        }
+    }
+
+    GestureSample Process(const GestureSample &in)
+    {
+        GestureSample out;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            sum[axis] += in[axis] - history[position][axis];
+            history[position][axis] = in[axis];
+            out[axis] = (int16_t)filter_divide(sum[axis], N);
+        }
+        position = position + 1 == N ? 0 : position + 1;
+        return out;
+    }
+
+private:
+    int16_t history[N][3]; // the window, oldest at `position`
+    int32_t sum[3];
+    size_t position;
+};
+
+// Second-order IIR section from the audio EQ cookbook, Direct Form I
+enum BiquadType
+{
+    BIQUAD_LOWPASS,
+    BIQUAD_HIGHPASS
+};
+
+// Cutoff and sample rate in Hz, quality factor in hundredths (71 is Butterworth)
+// Q14 coefficients and an int64 accumulator; the output is truncated towards zero, which
+// removes the energy a rounding limit cycle would need, so silence stays exactly 0
+template <BiquadType Type, int CutoffHz, int RateHz, int QualityX100 = 71>
+class Biquad
+{
+    static_assert(CutoffHz > 0 && 2 * CutoffHz < RateHz, "the cutoff has to be below the Nyquist frequency");
+
+public:
+    Biquad()
+    {
+        float w0 = 2.0f * (float)M_PI * CutoffHz / RateHz;
+        float alpha = sinf(w0) / (2.0f * QualityX100 / 100.0f);
+        float c = cosf(w0);
+        float a0 = 1.0f + alpha;
+        float b0 = Type == BIQUAD_LOWPASS ? (1.0f - c) / 2.0f : (1.0f + c) / 2.0f;
+        float b1 = Type == BIQUAD_LOWPASS ? 1.0f - c : -(1.0f + c);
+        b[0] = Coefficient(b0 / a0);
+        b[1] = Coefficient(b1 / a0);
+        b[2] = Coefficient(b0 / a0);
+        a[0] = Coefficient(-2.0f * c / a0);
+        a[1] = Coefficient((1.0f - alpha) / a0);
+        Reset();
+    }
+
+    void Reset()
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            x[axis][0] = x[axis][1] = 0;
+            y[axis][0] = y[axis][1] = 0;
+        }
+    }
+
+    GestureSample Process(const GestureSample &in)
+    {
+        GestureSample out;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            int64_t acc = (int64_t)b[0] * in[axis] + (int64_t)b[1] * x[axis][0] + (int64_t)b[2] * x[axis][1] -
+                          (int64_t)a[0] * y[axis][0] - (int64_t)a[1] * y[axis][1];
+            int64_t value = acc >= 0 ? acc >> 14 : -((-acc) >> 14);
+            x[axis][1] = x[axis][0];
+            x[axis][0] = in[axis];
+            y[axis][1] = y[axis][0];
+            y[axis][0] = filter_saturate(value);
+            out[axis] = y[axis][0];
+        }
+        return out;
+    }
+
+private:
+    static int32_t Coefficient(float value)
+    {
+        return (int32_t)lroundf(value * 16384.0f);
+    }
+
+    int32_t b[3]; // feed-forward, Q14
+    int32_t a[2]; // feedback a1, a2, Q14
+    int16_t x[3][2]; // last two inputs per axis
+    int16_t y[3][2]; // last two outputs per axis
+};
+
+// Median of the last N samples, N odd; removes single-sample spikes without smearing edges
+// Each axis keeps its window sorted, a sample costs one removal and one insertion, O(N)
+template <size_t N>
+class MedianFilter
+{
+    static_assert(N % 2 == 1, "the median needs an odd window");
+
+public:
+    MedianFilter()
+    {
+        Reset();
+    }
+
+    void Reset()
+    {
+        position = 0;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            for (size_t i = 0; i < N; i++)
+            {
+                history[axis][i] = 0;
+                sorted[axis][i] = 0;
+            }
+        }
+    }
+
+    GestureSample Process(const GestureSample &in)
+    {
+        GestureSample out;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            int16_t *s = sorted[axis];
+            int16_t oldest = history[axis][position];
+            history[axis][position] = in[axis];
+
+            // drop the oldest value, then shift the new one into place from there
+            size_t i = 0;
+            while (s[i] != oldest)
+                i++;
+            while (i > 0 && s[i - 1] > in[axis])
+            {
+                s[i] = s[i - 1];
+                i--;
+            }
+            while (i + 1 < N && s[i + 1] < in[axis])
+            {
+                s[i] = s[i + 1];
+                i++;
+            }
+            s[i] = in[axis];
+            out[axis] = s[N / 2];
+        }
+        position = position + 1 == N ? 0 : position + 1;
+        return out;
+    }
+
+private:
+    int16_t history[3][N]; // the window in arrival order, oldest at `position`
+    int16_t sorted[3][N];  // the same values sorted
+    size_t position;
+};
+
+// Exponential smoothing y += (x - y) / 2^Shift, the state keeps 8 fractional bits
+template <int Shift>
+class ExponentialSmoothing
+{
+    static_assert(Shift >= 1 && Shift <= 8, "alpha between 1/2 and 1/256");
+
+public:
+    ExponentialSmoothing()
+    {
+        Reset();
+    }
+
+    void Reset()
+    {
+        for (int axis = 0; axis < 3; axis++)
+            state[axis] = 0;
+    }
+
+    GestureSample Process(const GestureSample &in)
+    {
+        GestureSample out;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            int32_t target = (int32_t)in[axis] * 256;
+            int32_t step = target - state[axis];
+            state[axis] += step >= 0 ? step >> Shift : -((-step) >> Shift); // towards zero, reaches silence exactly
+            out[axis] = (int16_t)filter_divide(state[axis], 256);
+        }
+        return out;
+    }
+
+private:
+    int32_t state[3]; // Q8
+};
+
+// Stages applied left to right, FilterChain<> passes samples through
+template <typename... Stages>
+class FilterChain;
+
+template <>
+class FilterChain<>
+{
+public:
+    void Reset()
+    {
+    }
+
+    GestureSample Process(const GestureSample &in)
+    {
+        return in;
+    }
+};
+
+template <typename First, typename... Rest>
+class FilterChain<First, Rest...>
+{
+public:
+    void Reset()
+    {
+        first.Reset();
+        rest.Reset();
+    }
+
+    GestureSample Process(const GestureSample &in)
+    {
+        return rest.Process(first.Process(in));
+    }
+
+    // The first stage and the chain after it, e.g. to time the stages one by one
+    First &Head()
+    {
+        return first;
+    }
+
+    FilterChain<Rest...> &Tail()
+    {
+        return rest;
+    }
+
+private:
+    First first;
+    FilterChain<Rest...> rest;
+};
+
+#endif
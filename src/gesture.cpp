@@ -0,0 +1,912 @@
+#include <vector>
+#include <array>
+#include <limits>
+#include <cmath>
+#include "gesture.h"
+#include "dsp_kernels.h"
+#include "fft.h"
+
+int err = 0; // for error checking
+
+float dtw_rows[2][RECORD_CAPACITY + 1]; // rolling rows of the DTW cost matrix
+
+GestureAxes correlation_scratch[2]; // per-axis copies for calculateCorrelationVectors
+CanonicalAxes canonical_scratch;    // a key resampled before it is quantized
+
+// Catmull-Rom weights of the samples at -1, 0, +1, +2 for each fractional phase, Q14, every row sums to 16384
+const int16_t cubic_weights[RESAMPLE_CUBIC_PHASES][4] = {
+    {0, 16384, 0, 0}, {-124, 16374, 136, -2}, {-240, 16345, 287, -8}, {-349, 16297, 453, -17},
+    {-450, 16230, 634, -30}, {-544, 16146, 828, -46}, {-631, 16044, 1036, -65}, {-711, 15926, 1256, -87},
+    {-784, 15792, 1488, -112}, {-851, 15642, 1732, -139}, {-911, 15478, 1986, -169}, {-966, 15299, 2251, -200},
+    {-1014, 15106, 2526, -234}, {-1057, 14900, 2810, -269}, {-1094, 14681, 3103, -306}, {-1125, 14450, 3404, -345},
+    {-1152, 14208, 3712, -384}, {-1174, 13955, 4027, -424}, {-1190, 13691, 4349, -466}, {-1202, 13417, 4677, -508},
+    {-1210, 13134, 5010, -550}, {-1213, 12842, 5348, -593}, {-1213, 12542, 5690, -635}, {-1208, 12235, 6035, -678},
+    {-1200, 11920, 6384, -720}, {-1188, 11599, 6735, -762}, {-1173, 11272, 7088, -803}, {-1155, 10939, 7443, -843},
+    {-1134, 10602, 7798, -882}, {-1110, 10260, 8154, -920}, {-1084, 9915, 8509, -956}, {-1055, 9567, 8863, -991},
+    {-1024, 9216, 9216, -1024}, {-991, 8863, 9567, -1055}, {-956, 8509, 9915, -1084}, {-920, 8154, 10260, -1110},
+    {-882, 7798, 10602, -1134}, {-843, 7443, 10939, -1155}, {-803, 7088, 11272, -1173}, {-762, 6735, 11599, -1188},
+    {-720, 6384, 11920, -1200}, {-678, 6035, 12235, -1208}, {-635, 5690, 12542, -1213}, {-593, 5348, 12842, -1213},
+    {-550, 5010, 13134, -1210}, {-508, 4677, 13417, -1202}, {-466, 4349, 13691, -1190}, {-424, 4027, 13955, -1174},
+    {-384, 3712, 14208, -1152}, {-345, 3404, 14450, -1125}, {-306, 3103, 14681, -1094}, {-269, 2810, 14900, -1057},
+    {-234, 2526, 15106, -1014}, {-200, 2251, 15299, -966}, {-169, 1986, 15478, -911}, {-139, 1732, 15642, -851},
+    {-112, 1488, 15792, -784}, {-87, 1256, 15926, -711}, {-65, 1036, 16044, -631}, {-46, 828, 16146, -544},
+    {-30, 634, 16230, -450}, {-17, 453, 16297, -349}, {-8, 287, 16345, -240}, {-2, 136, 16374, -124},
+};
+
+float xcorr_spectrum[2][FFT_MAX_SIZE];          // FFT scratch of the cross-correlation, 4 KB
+float xcorr_prefix[4][RECORD_CAPACITY + 1];     // prefix sums of a, a^2, b, b^2 for the overlap statistics
+
+/*******************************************************************************
+ *
+ * @brief Calculate the euclidean distance between two vectors
+ * @param a: the first vector
+ * @param b: the second vector
+ * @return the euclidean distance between the two vectors
+ *
+ * ****************************************************************************/
+float euclidean_distance(const GestureSample &a, const GestureSample &b)
+{
+    return sqrtf((float)frame_cost_l2(a.data(), b.data(), 3)); // exact, a 3-axis sum of squares overflows int32
+}
+
+/*******************************************************************************
+ *
+ * @brief Euclidean distance of the part of each axis difference outside a tolerance
+ * Differences within the spread of an averaged key cost nothing, a zero spread
+ * gives the plain euclidean distance
+ * @param a: the key sample
+ * @param b: the sample to compare
+ * @param spread: the per-axis tolerance around a
+ * @return the distance beyond the tolerance
+ *
+ * ****************************************************************************/
+float envelope_distance(const GestureSample &a, const GestureSample &b, const GestureSample &spread)
+{
+    uint64_t sum = 0;
+    for (size_t axis = 0; axis < 3; ++axis)
+    {
+        int32_t d = abs((int32_t)a[axis] - b[axis]) - spread[axis];
+        if (d > 0)
+        {
+            sum += (uint64_t)((uint32_t)d * (uint32_t)d); // d < 2^16, the square fits
+        }
+    }
+    return sqrtf((float)sum);
+}
+
+/*******************************************************************************
+ *
+ * @brief Calculate the DTW distance between two vectors
+ * Sakoe-Chiba band around the diagonal from (0, 0) to (n, m), two rolling rows,
+ * and early abandoning once a whole row is above the threshold.
+ * Memory is two rows of RECORD_CAPACITY + 1, time is O(n * band).
+ * @param s: the first vectorS
+ * @param t: the second vector
+ * @param band: half width of the warping window in samples
+ * @param threshold: the normalized distance above which the result no longer matters
+ * @param spread: per-sample tolerance of s if it is an averaged key, nullptr for the euclidean cost
+ * @return the DTW distance normalized by n + m, infinity once it can no longer end below the threshold
+ *
+ * ****************************************************************************/
+float dtw(const GestureRecord &s, const GestureRecord &t, size_t band, float threshold, const GestureRecord *spread)
+{
+    const float inf = numeric_limits<float>::infinity();
+    size_t n = s.size();
+    size_t m = t.size();
+    if (n == 0 || m == 0)
+    {
+        return inf;
+    }
+
+    // the band has to be wider than the slope of the diagonal to keep a path open
+    size_t step = m / n + 1;
+    band = max(band, step);
+    float limit = threshold * (n + m);
+
+    float *prev = dtw_rows[0];
+    float *curr = dtw_rows[1];
+    prev[0] = 0;
+    for (size_t j = 1; j <= min(m, band + step); ++j)
+    {
+        prev[j] = inf;
+    }
+
+    for (size_t i = 1; i <= n; ++i)
+    {
+        size_t center = i * m / n;
+        size_t lo = center > band ? center - band : 1;
+        size_t hi = min(m, center + band);
+
+        curr[lo - 1] = inf;
+        float row_min = inf;
+        for (size_t j = lo; j <= hi; ++j)
+        {
+            float cost = spread == nullptr ? euclidean_distance(s[i - 1], t[j - 1])
+                                           : envelope_distance(s[i - 1], t[j - 1], (*spread)[i - 1]);
+            curr[j] = cost + min({prev[j], curr[j - 1], prev[j - 1]});
+            row_min = min(row_min, curr[j]);
+        }
+        // the next row reaches at most `step` further to the right
+        for (size_t j = hi + 1; j <= min(m, hi + step); ++j)
+        {
+            curr[j] = inf;
+        }
+
+        // every path crosses this row, none can end below the limit anymore
+        if (row_min > limit)
+        {
+            return inf;
+        }
+        swap(prev, curr);
+    }
+
+    return prev[m] / (n + m);
+}
+
+/*******************************************************************************
+ *
+ * @brief LB_Kim lower bound of the DTW distance, O(1)
+ * Every warping path starts at the first pair and ends at the last pair of samples
+ * @param key: the gesture key
+ * @param query: the unlocking record
+ * @param spread: per-sample tolerance of the key like in dtw()
+ * @return the lower bound normalized by n + m like dtw()
+ *
+ * ****************************************************************************/
+float lb_kim(const GestureRecord &key, const GestureRecord &query, const GestureRecord *spread)
+{
+    size_t n = query.size();
+    size_t m = key.size();
+    if (n == 0 || m == 0)
+    {
+        return numeric_limits<float>::infinity();
+    }
+
+    if (spread != nullptr)
+    {
+        float bound = envelope_distance(key[0], query[0], (*spread)[0]);
+        if (n > 1 || m > 1)
+        {
+            bound += envelope_distance(key[m - 1], query[n - 1], (*spread)[m - 1]);
+        }
+        return bound / (n + m);
+    }
+
+    float bound = euclidean_distance(query[0], key[0]);
+    if (n > 1 || m > 1)
+    {
+        bound += euclidean_distance(query[n - 1], key[m - 1]); // a different cell of the path
+    }
+    return bound / (n + m);
+}
+
+/*******************************************************************************
+ *
+ * @brief LB_Keogh lower bound of the banded DTW distance
+ * dtw(key, query) walks the key rows and centers the band on i * n / m in the query
+ * columns, so query column j can only be paired with the key samples whose center
+ * lies within the band of j; seen from the key that window is band * m / n wide.
+ * Every warping path visits every query column, so the distance of query[j] to the
+ * box around those key samples can not exceed the cost of the path in column j.
+ * The box is assembled from the stored +-key.band envelope, one lookup per
+ * 2 key.band + 1 key samples, so a key longer than the query costs m / n lookups
+ * per query sample and the bound holds for every pair of lengths
+ * @param key: the gesture key with its envelope
+ * @param query: the unlocking record
+ * @return the lower bound normalized by n + m like dtw()
+ *
+ * ****************************************************************************/
+float lb_keogh(const GestureKey &key, const GestureRecord &query)
+{
+    size_t n = query.size();
+    size_t m = key.samples.size();
+    if (n == 0 || m == 0)
+    {
+        return numeric_limits<float>::infinity();
+    }
+
+    // the band dtw() uses with the key as its first argument
+    size_t band = max(key.band, n / m + 1);
+
+    float bound = 0;
+    for (size_t j = 1; j <= n; ++j)
+    {
+        // key rows i with j - band <= i * n / m <= j + band, converted to 0-based key indices
+        size_t first = j > band ? ((j - band) * m + n - 1) / n : 1;
+        size_t last = min(m, ((j + band + 1) * m + n - 1) / n - 1);
+        first = max(first, (size_t)1) - 1;
+        last = last - 1;
+
+        int32_t upper[3] = {INT16_MIN, INT16_MIN, INT16_MIN};
+        int32_t lower[3] = {INT16_MAX, INT16_MAX, INT16_MAX};
+        for (size_t start = first; start <= last;)
+        {
+            // the stored envelope at c covers key samples c - key.band .. c + key.band
+            size_t c = min(start + key.band, m - 1);
+            for (size_t axis = 0; axis < 3; ++axis)
+            {
+                upper[axis] = max(upper[axis], (int32_t)key.upper[c][axis]);
+                lower[axis] = min(lower[axis], (int32_t)key.lower[c][axis]);
+            }
+            start = c + key.band + 1;
+        }
+
+        int32_t sum = 0;
+        for (size_t axis = 0; axis < 3; ++axis)
+        {
+            int32_t q = query[j - 1][axis];
+            int32_t d = 0;
+            if (q > upper[axis])
+            {
+                d = q - upper[axis];
+            }
+            else if (q < lower[axis])
+            {
+                d = lower[axis] - q;
+            }
+            sum += d * d;
+        }
+        bound += sqrtf((float)sum);
+    }
+    return bound / (n + m);
+}
+
+/*******************************************************************************
+ *
+ * @brief The per-sample tolerance to pass to dtw() and lb_kim() for a key
+ * @param key: the gesture key
+ * @return the spread of an averaged key, nullptr for a single recording
+ *
+ * ****************************************************************************/
+const GestureRecord *key_spread(const GestureKey &key)
+{
+    return key.spread.empty() ? nullptr : &key.spread;
+}
+
+/*******************************************************************************
+ *
+ * @brief Save a gesture key together with its LB_Keogh envelope and its correlation sums
+ * The envelope of an averaged key is widened by the spread of each sample, so
+ * LB_Keogh stays a lower bound of the DTW with the envelope distance
+ * @param key: the key to fill
+ * @param samples: the recorded gesture, or the average of several repetitions
+ * @param band: the DTW band the envelope is computed for
+ * @param spread: per-axis tolerance of each sample, nullptr for a single recording
+ *
+ * ****************************************************************************/
+void build_gesture_key(GestureKey &key, const GestureRecord &samples, size_t band, const GestureRecord *spread)
+{
+    size_t m = samples.size();
+
+    key.samples = samples;
+    to_axes(key.axes, samples);
+    resample_canonical(canonical_scratch, samples);
+    quantize_canonical(key.canonical, canonical_scratch);
+    quantized_stats(key.canonical_stats, key.canonical);
+    key.band = band;
+    key.upper.resize(m);
+    key.lower.resize(m);
+    key.spread.clear();
+    if (spread != nullptr)
+    {
+        key.spread = *spread;
+    }
+
+    for (size_t j = 0; j < m; ++j)
+    {
+        size_t lo = j > band ? j - band : 0;
+        size_t hi = min(m - 1, j + band);
+        int32_t upper[3] = {INT16_MIN, INT16_MIN, INT16_MIN};
+        int32_t lower[3] = {INT16_MAX, INT16_MAX, INT16_MAX};
+        for (size_t k = lo; k <= hi; ++k)
+        {
+            for (size_t axis = 0; axis < 3; ++axis)
+            {
+                int32_t tolerance = spread != nullptr ? (*spread)[k][axis] : 0;
+                upper[axis] = max(upper[axis], samples[k][axis] + tolerance);
+                lower[axis] = min(lower[axis], samples[k][axis] - tolerance);
+            }
+        }
+        for (size_t axis = 0; axis < 3; ++axis)
+        {
+            key.upper[j][axis] = (int16_t)min(upper[axis], (int32_t)INT16_MAX);
+            key.lower[j][axis] = (int16_t)max(lower[axis], (int32_t)INT16_MIN);
+        }
+    }
+}
+
+/*******************************************************************************
+ *
+ * @brief Enroll a gesture in the template store, its envelope is precomputed once here
+ * @param store: the template store
+ * @param samples: the recorded gesture
+ * @param band: the DTW band of the envelope
+ * @param spread: per-axis tolerance of each sample of an averaged key, nullptr for a single recording
+ * @return the index of the new template, -1 if the store is full
+ *
+ * ****************************************************************************/
+int add_template(TemplateStore &store, const GestureRecord &samples, size_t band, const GestureRecord *spread)
+{
+    GestureKey *key = store.append_slot(); // built in place, a GestureKey is too big for the stack
+    if (key == nullptr)
+    {
+        return -1;
+    }
+    build_gesture_key(*key, samples, band, spread);
+    return store.size() - 1;
+}
+
+/*******************************************************************************
+ *
+ * @brief Find the enrolled template closest to an unlocking record
+ * The templates are ranked by their lower bounds and searched best first; the
+ * search stops as soon as the next lower bound exceeds the best distance so far,
+ * and the DTW of every template abandons at that distance
+ * @param store: the template store
+ * @param query: the unlocking record
+ * @param threshold: the normalized DTW distance to accept
+ * @param distance: the DTW distance of the match, infinity if none matched
+ * @param stats: counts how many templates each stage rejected
+ * @return the index of the matching template, -1 if none is below the threshold
+ *
+ * ****************************************************************************/
+int match_templates(const TemplateStore &store, const GestureRecord &query, float threshold, float &distance, MatchCascadeStats &stats)
+{
+    float bound[TEMPLATE_CAPACITY];
+    size_t order[TEMPLATE_CAPACITY];
+    size_t candidates = 0;
+
+    // lower bound of every template, insertion sorted by bound
+    for (size_t t = 0; t < store.size(); ++t)
+    {
+        stats.attempts++;
+        float lb = lb_kim(store[t].samples, query, key_spread(store[t]));
+        if (lb > threshold)
+        {
+            stats.pruned_kim++;
+            continue;
+        }
+        lb = max(lb, lb_keogh(store[t], query));
+        if (lb > threshold)
+        {
+            stats.pruned_keogh++;
+            continue;
+        }
+
+        size_t k = candidates++;
+        while (k > 0 && bound[k - 1] > lb)
+        {
+            bound[k] = bound[k - 1];
+            order[k] = order[k - 1];
+            --k;
+        }
+        bound[k] = lb;
+        order[k] = t;
+    }
+
+    int match = -1;
+    distance = numeric_limits<float>::infinity();
+    float best = threshold;
+    for (size_t k = 0; k < candidates; ++k)
+    {
+        if (bound[k] > best)
+        {
+            stats.pruned_keogh += candidates - k; // no remaining template can beat the best one
+            break;
+        }
+        const GestureKey &key = store[order[k]];
+        float d = dtw(key.samples, query, key.band, best, key_spread(key));
+        if (d <= best)
+        {
+            if (match >= 0)
+            {
+                stats.pruned_dtw++; // the previous best is beaten
+            }
+            best = d;
+            distance = d;
+            match = order[k];
+        }
+        else
+        {
+            stats.pruned_dtw++;
+        }
+    }
+    if (match >= 0)
+    {
+        stats.accepted++;
+    }
+    return match;
+}
+
+/*******************************************************************************
+ *
+ * @brief Trim the gyro data
+ * @param data: the gyro data to trim
+ *
+ * ****************************************************************************/
+void trim_gyro_data(GestureRecord &data)
+{
+    auto ptr = data.begin();
+    // find the first element where data from any
+    // one direction is not zero (calibration puts noise to exactly zero)
+    while (ptr != data.end() && (*ptr)[0] == 0 && (*ptr)[1] == 0 && (*ptr)[2] == 0)
+    {
+        ptr++;
+    }
+    if (ptr == data.end())
+    {
+        data.clear(); // all data less than threshold, nothing was recorded
+        return;
+    }
+    auto lptr = ptr; // record the left bound
+    // start searching from end to front
+    ptr = data.end() - 1;
+    while ((*ptr)[0] == 0 && (*ptr)[1] == 0 && (*ptr)[2] == 0)
+    {
+        ptr--;
+    }
+    auto rptr = ptr; // record the right bound
+    // start moving elements to the front
+    auto replace_ptr = data.begin();
+    for (; replace_ptr != lptr && lptr <= rptr; replace_ptr++, lptr++)
+    {
+        *replace_ptr = *lptr;
+    }
+    // trim the end
+    if (lptr > rptr)
+    {
+        data.erase(replace_ptr, data.end());
+    }
+    else
+    {
+        data.erase(rptr + 1, data.end());
+    }
+}
+
+/*******************************************************************************
+ *
+ * @brief Copy a recording into structure-of-arrays form
+ * @param axes: the per-axis copy to fill
+ * @param record: the recording
+ *
+ * ****************************************************************************/
+void to_axes(GestureAxes &axes, const GestureRecord &record)
+{
+    axes.size = record.size();
+    for (size_t i = 0; i < axes.size; ++i)
+    {
+        axes.axis[0][i] = record[i][0];
+        axes.axis[1][i] = record[i][1];
+        axes.axis[2][i] = record[i][2];
+    }
+}
+
+/*******************************************************************************
+ *
+ * @brief Fewest samples two recordings may be compared over without resampling
+ * @param na: length of the first recording
+ * @param nb: length of the second recording
+ * @return 1 / MIN_OVERLAP_FRACTION of the longer one, rounded up, at least 2
+ *
+ * ****************************************************************************/
+size_t min_overlap(size_t na, size_t nb)
+{
+    size_t longer = max(na, nb);
+    return max((longer + MIN_OVERLAP_FRACTION - 1) / MIN_OVERLAP_FRACTION, (size_t)2);
+}
+
+/*******************************************************************************
+ *
+ * @brief Pearson correlation from the five integer sums
+ * @param sums: the sums of n sample pairs
+ * @param n: number of sample pairs
+ * @param result: the correlation, 0 if it is undefined
+ * @return false if one of the sequences is flat
+ *
+ * ****************************************************************************/
+bool correlation_from_sums(const CorrelationSums &sums, int64_t n, float &result)
+{
+    // the correlation is scale invariant, so the sensitivity never has to be applied
+    float numerator = (float)(n * sums.sum_ab - (int64_t)sums.sum_a * sums.sum_b); // Covariance
+
+    float denominator = sqrtf((float)(n * sums.sq_sum_a - (int64_t)sums.sum_a * sums.sum_a) *
+                              (float)(n * sums.sq_sum_b - (int64_t)sums.sum_b * sums.sum_b)); // Standard deviation
+
+    if (!(denominator > 0.0f))
+    {
+        result = 0.0f;
+        return false;
+    }
+    result = numerator / denominator;
+    return true;
+}
+
+/*******************************************************************************
+ *
+ * @brief Calculate the correlation of all three axes
+ * The five sums of an axis are accumulated in one pass of the DSP kernel over the
+ * samples both recordings have; the tail of the longer one is ignored instead of
+ * being compared against zeros, as long as the shared samples cover min_overlap()
+ * @param a: the first recording
+ * @param b: the second recording
+ * @return the correlation of each axis, err is set if it is undefined or the overlap is too short
+ *
+ * ****************************************************************************/
+array<float, 3> correlation_axes(const GestureAxes &a, const GestureAxes &b)
+{
+    array<float, 3> result = {0.0f, 0.0f, 0.0f};
+    size_t n = min(a.size, b.size);
+    if (n < min_overlap(a.size, b.size))
+    {
+        err = -1;
+        return result;
+    }
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        // integer sums on the raw counts, exact for any recording that fits in a GestureRecord
+        CorrelationSums sums;
+        correlation_sums_q15(a.axis[axis], b.axis[axis], n, sums);
+        if (!correlation_from_sums(sums, n, result[axis]))
+        {
+            err = -1; // a flat axis has no correlation
+        }
+    }
+    return result;
+}
+
+/*******************************************************************************
+ *
+ * @brief Calculate the correlation between two recordings
+ * Converts both to structure-of-arrays in static scratch buffers, callers that
+ * match one attempt against several keys should use correlation_axes directly
+ * @param vec1: the first recording
+ * @param vec2: the second recording
+ * @return the correlation of each axis
+ *
+ * ****************************************************************************/
+array<float, 3> calculateCorrelationVectors(const GestureRecord &vec1, const GestureRecord &vec2)
+{
+    to_axes(correlation_scratch[0], vec1);
+    to_axes(correlation_scratch[1], vec2);
+    return correlation_axes(correlation_scratch[0], correlation_scratch[1]);
+}
+
+/*******************************************************************************
+ *
+ * @brief Normalized cross-correlation of each axis over the lags -max_lag..max_lag
+ * The raw cross products of all lags come from one FFT of each recording and an
+ * inverse FFT of their product; every lag is then normalized with the means and
+ * variances of just the overlapping samples, taken from prefix sums, so a gesture
+ * performed a little later scores like one performed on time. Only lags whose
+ * overlap covers min_overlap() samples are scored
+ * @param a: the first recording, e.g. the key
+ * @param b: the second recording, e.g. the unlocking attempt
+ * @param max_lag: largest shift in samples, in either direction
+ * @return the peak score and its lag for each axis, err is set if no lag had a defined score
+ *
+ * ****************************************************************************/
+array<XcorrPeak, 3> xcorr_axes(const GestureAxes &a, const GestureAxes &b, size_t max_lag)
+{
+    array<XcorrPeak, 3> result;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        result[axis].score = 0.0f;
+        result[axis].lag = 0;
+    }
+
+    int na = a.size;
+    int nb = b.size;
+    if (na < 2 || nb < 2)
+    {
+        err = -1;
+        return result;
+    }
+
+    // linear, not circular, correlation for every lag: n >= na + nb
+    size_t n = 4;
+    while (n < (size_t)(na + nb))
+    {
+        n <<= 1;
+    }
+    int lag_limit = (int)max_lag;
+    int overlap_limit = (int)min_overlap(na, nb); // edge lags with a few samples left score close to +-1 by chance
+
+    float *fa = xcorr_spectrum[0];
+    float *fb = xcorr_spectrum[1];
+    float *pa = xcorr_prefix[0], *paa = xcorr_prefix[1], *pb = xcorr_prefix[2], *pbb = xcorr_prefix[3];
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        // remove the means first, keeps the float sums well conditioned
+        int32_t sum_a = 0, sum_b = 0;
+        for (int i = 0; i < na; ++i)
+        {
+            sum_a += a.axis[axis][i];
+        }
+        for (int i = 0; i < nb; ++i)
+        {
+            sum_b += b.axis[axis][i];
+        }
+        float mean_a = (float)sum_a / na;
+        float mean_b = (float)sum_b / nb;
+
+        pa[0] = paa[0] = pb[0] = pbb[0] = 0.0f;
+        for (int i = 0; i < (int)n; ++i)
+        {
+            fa[i] = i < na ? a.axis[axis][i] - mean_a : 0.0f;
+            fb[i] = i < nb ? b.axis[axis][i] - mean_b : 0.0f;
+            if (i < na)
+            {
+                pa[i + 1] = pa[i] + fa[i];
+                paa[i + 1] = paa[i] + fa[i] * fa[i];
+            }
+            if (i < nb)
+            {
+                pb[i + 1] = pb[i] + fb[i];
+                pbb[i + 1] = pbb[i] + fb[i] * fb[i];
+            }
+        }
+
+        // conj(A) B transforms back to r[lag] = sum a[i] b[i + lag], negative lags wrap around
+        fft_real(fa, n);
+        fft_real(fb, n);
+        fb[0] *= fa[0];
+        fb[1] *= fa[1];
+        for (size_t k = 2; k < n; k += 2)
+        {
+            float re = fa[k] * fb[k] + fa[k + 1] * fb[k + 1];
+            float im = fa[k] * fb[k + 1] - fa[k + 1] * fb[k];
+            fb[k] = re;
+            fb[k + 1] = im;
+        }
+        ifft_real(fb, n);
+
+        bool found = false;
+        for (int lag = -lag_limit; lag <= lag_limit; ++lag)
+        {
+            int i0 = max(0, -lag);
+            int i1 = min(na, nb - lag);
+            int m = i1 - i0;
+            if (m < overlap_limit)
+            {
+                continue;
+            }
+            float overlap_a = pa[i1] - pa[i0];
+            float sq_overlap_a = paa[i1] - paa[i0];
+            float overlap_b = pb[i1 + lag] - pb[i0 + lag];
+            float sq_overlap_b = pbb[i1 + lag] - pbb[i0 + lag];
+            float cross = fb[lag < 0 ? lag + (int)n : lag];
+
+            float denominator = sqrtf((m * sq_overlap_a - overlap_a * overlap_a) * (m * sq_overlap_b - overlap_b * overlap_b));
+            if (!(denominator > 0.0f))
+            {
+                continue; // one of the overlaps is flat
+            }
+            float score = fminf(fmaxf((m * cross - overlap_a * overlap_b) / denominator, -1.0f), 1.0f); // float cancellation
+            if (!found || score > result[axis].score)
+            {
+                result[axis].score = score;
+                result[axis].lag = lag;
+                found = true;
+            }
+        }
+        if (!found)
+        {
+            err = -1;
+        }
+    }
+    return result;
+}
+
+/*******************************************************************************
+ *
+ * @brief Resample a recording to CANONICAL_LENGTH samples
+ * The first and last samples map onto each other, so recordings of a gesture
+ * performed faster or slower line up; positions are Q16 fixed point and the
+ * interpolation is linear or Catmull-Rom depending on RESAMPLE_METHOD
+ * @param out: the resampled recording
+ * @param in: the recording, any length
+ *
+ * ****************************************************************************/
+void resample_canonical(CanonicalAxes &out, const GestureRecord &in)
+{
+    int32_t n = in.size();
+    if (n < 2)
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            for (size_t k = 0; k < CANONICAL_LENGTH; ++k)
+            {
+                out.axis[axis][k] = n == 1 ? in[0][axis] : 0;
+            }
+        }
+        return;
+    }
+
+    uint32_t step = ((uint32_t)(n - 1) << 16) / (CANONICAL_LENGTH - 1); // input samples per output sample, Q16
+    for (size_t k = 0; k < CANONICAL_LENGTH; ++k)
+    {
+        uint32_t position = k * step;
+        int32_t i = min((int32_t)(position >> 16), n - 1);
+        uint32_t frac = position & 0xFFFF;
+        int32_t next = min(i + 1, n - 1);
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+#if RESAMPLE_METHOD == RESAMPLE_CUBIC
+            const int16_t *w = cubic_weights[frac >> 10]; // 16-bit fraction to a 6-bit phase
+            int32_t acc = w[0] * in[max(i - 1, 0)][axis] + w[1] * in[i][axis] + w[2] * in[next][axis] +
+                          w[3] * in[min(i + 2, n - 1)][axis];
+            int32_t value = (acc + (1 << 13)) >> 14;
+            out.axis[axis][k] = (int16_t)min(max(value, (int32_t)INT16_MIN), (int32_t)INT16_MAX); // the spline can overshoot
+#else
+            int32_t delta = in[next][axis] - in[i][axis];
+            out.axis[axis][k] = (int16_t)(in[i][axis] + (((int64_t)delta * frac + (1 << 15)) >> 16));
+#endif
+        }
+    }
+}
+
+/*******************************************************************************
+ *
+ * @brief Calculate the correlation of two recordings resampled to CANONICAL_LENGTH
+ * @param a: the first recording
+ * @param b: the second recording
+ * @return the correlation of each axis, err is set if an axis is flat
+ *
+ * ****************************************************************************/
+array<float, 3> correlation_canonical(const CanonicalAxes &a, const CanonicalAxes &b)
+{
+    array<float, 3> result;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        // the length is a compile-time constant, the inlined kernel needs no tail loop
+        CorrelationSums sums;
+        correlation_sums_q15(a.axis[axis], b.axis[axis], CANONICAL_LENGTH, sums);
+        if (!correlation_from_sums(sums, CANONICAL_LENGTH, result[axis]))
+        {
+            err = -1;
+        }
+    }
+    return result;
+}
+
+/*******************************************************************************
+ *
+ * @brief Quantize a canonical recording to int8 with a scale and an offset per axis
+ * The axis range is split into 255 steps around its middle, rounded to the nearest step
+ * @param out: the quantized recording
+ * @param in: the recording resampled to CANONICAL_LENGTH
+ *
+ * ****************************************************************************/
+void quantize_canonical(QuantizedCanonical &out, const CanonicalAxes &in)
+{
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        int32_t lo = in.axis[axis][0];
+        int32_t hi = in.axis[axis][0];
+        for (size_t k = 1; k < CANONICAL_LENGTH; ++k)
+        {
+            lo = min(lo, (int32_t)in.axis[axis][k]);
+            hi = max(hi, (int32_t)in.axis[axis][k]);
+        }
+        int32_t offset = (lo + hi) / 2;
+        int32_t scale = (hi - lo + 253) / 254; // ceil((hi - lo) / 254), |q| <= 127 at both ends
+        if (scale < 1)
+        {
+            scale = 1;
+        }
+        out.offset[axis] = (int16_t)offset;
+        out.scale[axis] = (uint16_t)scale;
+
+        for (size_t k = 0; k < CANONICAL_LENGTH; ++k)
+        {
+            int32_t d = in.axis[axis][k] - offset;
+            int32_t q = (d >= 0 ? d + scale / 2 : d - scale / 2) / scale; // round half away from zero
+            out.axis[axis][k] = (int8_t)min(max(q, (int32_t)-127), (int32_t)127);
+        }
+    }
+}
+
+/*******************************************************************************
+ *
+ * @brief Calculate the correlation of an int8 key against a canonical recording
+ * The int8 values are correlated as they are, scale and offset drop out of the
+ * normalization; only the rounding to 255 steps differs from correlation_canonical
+ * @param key: the quantized key
+ * @param b: the recording
+ * @return the correlation of each axis, err is set if an axis is flat
+ *
+ * ****************************************************************************/
+array<float, 3> correlation_canonical_q7(const QuantizedCanonical &key, const CanonicalAxes &b)
+{
+    array<float, 3> result;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        CorrelationSums sums;
+        correlation_sums_q7_q15(key.axis[axis], b.axis[axis], CANONICAL_LENGTH, sums);
+        if (!correlation_from_sums(sums, CANONICAL_LENGTH, result[axis]))
+        {
+            err = -1;
+        }
+    }
+    return result;
+}
+
+/*******************************************************************************
+ *
+ * @brief Per-axis sums of a canonical recording, once per attempt for all keys
+ * @param stats: the sums to fill
+ * @param in: the recording resampled to CANONICAL_LENGTH
+ *
+ * ****************************************************************************/
+void canonical_stats(CanonicalStats &stats, const CanonicalAxes &in)
+{
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        int32_t sum = 0;
+        for (size_t k = 0; k < CANONICAL_LENGTH; ++k)
+        {
+            sum += in.axis[axis][k];
+        }
+        stats.sum[axis] = sum;
+        stats.sq_sum[axis] = sum_squares_q15(in.axis[axis], CANONICAL_LENGTH);
+    }
+}
+
+/*******************************************************************************
+ *
+ * @brief Per-axis sums of an int8 key, computed once when the key is saved
+ * @param stats: the sums to fill
+ * @param in: the quantized key
+ *
+ * ****************************************************************************/
+void quantized_stats(CanonicalStats &stats, const QuantizedCanonical &in)
+{
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        int32_t sum = 0;
+        int64_t sq_sum = 0;
+        for (size_t k = 0; k < CANONICAL_LENGTH; ++k)
+        {
+            sum += in.axis[axis][k];
+            sq_sum += (int32_t)in.axis[axis][k] * in.axis[axis][k];
+        }
+        stats.sum[axis] = sum;
+        stats.sq_sum[axis] = sq_sum;
+    }
+}
+
+/*******************************************************************************
+ *
+ * @brief Calculate the correlation of an int8 key against a canonical recording from cached sums
+ * Same result as correlation_canonical_q7 without the sums, but only the cross
+ * term is accumulated per key: the key sums come from enrollment and the sums of
+ * the recording are computed once for all keys
+ * @param key: the quantized key
+ * @param key_stats: its sums from quantized_stats
+ * @param b: the recording
+ * @param b_stats: its sums from canonical_stats
+ * @return the correlation of each axis, err is set if an axis is flat
+ *
+ * ****************************************************************************/
+array<float, 3> correlation_canonical_q7(const QuantizedCanonical &key, const CanonicalStats &key_stats,
+                                         const CanonicalAxes &b, const CanonicalStats &b_stats)
+{
+    array<float, 3> result;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        CorrelationSums sums;
+        sums.sum_a = key_stats.sum[axis];
+        sums.sq_sum_a = key_stats.sq_sum[axis];
+        sums.sum_b = b_stats.sum[axis];
+        sums.sq_sum_b = b_stats.sq_sum[axis];
+        sums.sum_ab = dot_q7_q15(key.axis[axis], b.axis[axis], CANONICAL_LENGTH);
+        if (!correlation_from_sums(sums, CANONICAL_LENGTH, result[axis]))
+        {
+            err = -1;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,141 @@
+#ifndef __GESTURE_H
+#define __GESTURE_H
+
+#ifndef HOST_BUILD
+#include <mbed.h>
+#else
+// host build of the matcher for benchmarks, mbed.h would bring these in
+#include <stdint.h>
+#include <stddef.h>
+#include <algorithm>
+using namespace std;
+#endif
+#include <vector>
+#include <array>
+#include "static_vector.h"
+#include "dsp_kernels.h"
+
+// Rate in Hz the recordings are decimated to before matching, the sensor itself samples at the full ODR
+#define MATCH_RATE_HZ 50
+
+// Longest recording window in seconds, the recording buffers are sized for it at MATCH_RATE_HZ so they never reallocate
+#define RECORD_WINDOW_S 5
+#define RECORD_CAPACITY (RECORD_WINDOW_S * MATCH_RATE_HZ)
+
+// One calibrated sample in raw counts, i.e. a Q15 fraction of the selected full scale
+// Kept as int16 through trimming and matching, ConvertToDPS is only needed for display
+typedef array<int16_t, 3> GestureSample;
+
+// Fixed-capacity gesture recording, the recording path never allocates
+typedef StaticVector<GestureSample, RECORD_CAPACITY> GestureRecord;
+
+// The samples two recordings are compared over without resampling have to span at least
+// 1 / MIN_OVERLAP_FRACTION of the longer one, a few samples correlate close to +-1 by chance
+#define MIN_OVERLAP_FRACTION 2
+
+// Canonical length both recordings are resampled to before the correlation, a multiple of 16
+// so the DSP kernels run without a scalar tail; 128 samples cover 2.5 s at 50 Hz without loss
+#define CANONICAL_LENGTH 128
+
+// Interpolation of the length normalization
+#define RESAMPLE_LINEAR 0
+#define RESAMPLE_CUBIC 1 // Catmull-Rom from a Q14 weight table
+#define RESAMPLE_METHOD RESAMPLE_CUBIC
+#define RESAMPLE_CUBIC_PHASES 64
+
+// A recording resampled to CANONICAL_LENGTH, stored per axis
+typedef struct
+{
+    int16_t axis[3][CANONICAL_LENGTH];
+} CanonicalAxes;
+
+// A recording resampled to CANONICAL_LENGTH and quantized to int8 per axis, value ~ offset + scale * q
+// A quarter of the float and half of the int16 storage; the correlation is invariant to the
+// per-axis scale and offset, so it runs on the int8 values directly
+typedef struct
+{
+    int8_t axis[3][CANONICAL_LENGTH];
+    int16_t offset[3]; // raw counts at q = 0, the middle of the axis range
+    uint16_t scale[3]; // raw counts per step, at least 1
+} QuantizedCanonical;
+
+// Per-axis sums of a canonical recording, its share of the correlation sums
+// mean = sum / CANONICAL_LENGTH, centered norm^2 = (CANONICAL_LENGTH * sq_sum - sum^2) / CANONICAL_LENGTH
+typedef struct
+{
+    int32_t sum[3];
+    int64_t sq_sum[3];
+} CanonicalStats;
+
+// A recording stored structure-of-arrays, each axis contiguous for the fused correlation
+typedef struct
+{
+    int16_t axis[3][RECORD_CAPACITY];
+    size_t size;
+} GestureAxes;
+
+// Peak of the normalized cross-correlation of one axis over the lag window
+typedef struct
+{
+    float score; // correlation at the peak, -1..1
+    int lag;     // samples the second recording is behind the first one at the peak
+} XcorrPeak;
+
+// Gesture key with its LB_Keogh envelope, computed once when the key is saved
+typedef struct
+{
+    GestureRecord samples; // the recorded key
+    GestureAxes axes;      // the recorded key per axis
+    QuantizedCanonical canonical; // the recorded key resampled to CANONICAL_LENGTH, int8
+    CanonicalStats canonical_stats; // sums of the int8 canonical key, so an attempt only adds the cross term
+    GestureRecord upper;   // per-axis max of samples[j - band, j + band]
+    GestureRecord lower;   // per-axis min of samples[j - band, j + band]
+    GestureRecord spread;  // per-axis tolerance around each sample of an averaged key, empty for a single recording
+    size_t band;           // envelope half width, the DTW band it is valid for
+} GestureKey;
+
+// Number of unlocking attempts decided at each stage of the matcher cascade
+typedef struct
+{
+    uint32_t attempts;     // attempts seen
+    uint32_t pruned_kim;   // rejected by LB_Kim
+    uint32_t pruned_keogh; // rejected by LB_Keogh
+    uint32_t pruned_dtw;   // rejected (or abandoned) by the banded DTW
+    uint32_t accepted;     // DTW distance below the threshold
+} MatchCascadeStats;
+
+// Enrolled gesture keys, for several users or fallback gestures
+#define TEMPLATE_CAPACITY 4
+typedef StaticVector<GestureKey, TEMPLATE_CAPACITY> TemplateStore;
+
+extern int err; // for error checking
+
+/*******************************************************************************
+ * Function Prototypes of data processing
+ * ****************************************************************************/
+float euclidean_distance(const GestureSample &a, const GestureSample &b);
+float envelope_distance(const GestureSample &a, const GestureSample &b, const GestureSample &spread);
+float dtw(const GestureRecord &s, const GestureRecord &t, size_t band, float threshold, const GestureRecord *spread = nullptr);
+float lb_kim(const GestureRecord &key, const GestureRecord &query, const GestureRecord *spread = nullptr);
+float lb_keogh(const GestureKey &key, const GestureRecord &query);
+const GestureRecord *key_spread(const GestureKey &key);
+void build_gesture_key(GestureKey &key, const GestureRecord &samples, size_t band, const GestureRecord *spread = nullptr);
+int add_template(TemplateStore &store, const GestureRecord &samples, size_t band, const GestureRecord *spread = nullptr);
+int match_templates(const TemplateStore &store, const GestureRecord &query, float threshold, float &distance, MatchCascadeStats &stats);
+void trim_gyro_data(GestureRecord &data);
+void to_axes(GestureAxes &axes, const GestureRecord &record);
+size_t min_overlap(size_t na, size_t nb);
+bool correlation_from_sums(const CorrelationSums &sums, int64_t n, float &result);
+array<float, 3> correlation_axes(const GestureAxes &a, const GestureAxes &b);
+void resample_canonical(CanonicalAxes &out, const GestureRecord &in);
+array<float, 3> correlation_canonical(const CanonicalAxes &a, const CanonicalAxes &b);
+void quantize_canonical(QuantizedCanonical &out, const CanonicalAxes &in);
+array<float, 3> correlation_canonical_q7(const QuantizedCanonical &key, const CanonicalAxes &b);
+void canonical_stats(CanonicalStats &stats, const CanonicalAxes &in);
+void quantized_stats(CanonicalStats &stats, const QuantizedCanonical &in);
+array<float, 3> correlation_canonical_q7(const QuantizedCanonical &key, const CanonicalStats &key_stats,
+                                         const CanonicalAxes &b, const CanonicalStats &b_stats);
+array<float, 3> calculateCorrelationVectors(const GestureRecord &vec1, const GestureRecord &vec2);
+array<XcorrPeak, 3> xcorr_axes(const GestureAxes &a, const GestureAxes &b, size_t max_lag);
+
+#endif
@@ -24,7 +24,9 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 #include <mbed.h>
+#include <math.h>
 #include "gyro.h"
+#include "cycle_counter.h"
 
 SPI gyroscope(PF_9, PF_8, PF_7); // mosi, miso, sclk
 DigitalOut cs(PC_1);
@@ -39,15 +41,41 @@ int16_t z_sample; // Z-axis zero-rate level sample
 
 float sensitivity = 0.0f;
 
+Gyroscope_AxisStats bias_stats[3]; // background zero-rate estimate of X, Y and Z
+
+Gyroscope_CalibrationEntry calibration_cache[TEMP_CACHE_SIZE]; // calibrations per temperature bucket
+int8_t temperature_bucket = 0;                                 // bucket of the last temperature reading
+
+uint32_t fifo_overruns = 0; // number of bursts that found the FIFO overrun
+
+#define FIFO_BURST_BYTES (1 + FIFO_DEPTH * 6) // address byte + 6 bytes per sample
+
+uint8_t burst_tx[FIFO_BURST_BYTES];                 // address byte followed by dummy bytes
+uint8_t burst_rx[2][FIFO_BURST_BYTES];              // double buffer for asynchronous bursts
+Gyroscope_SampleBlock sample_blocks[2];             // unpacked double buffer
+volatile uint8_t active_block = 0;                  // half of the double buffer being filled
+volatile bool transfer_busy = false;                // asynchronous burst in flight
+void (*transfer_complete)(const Gyroscope_SampleBlock *block) = nullptr;
+
 Gyroscope_RawData *gyro_raw;
 
 // Write I/O
 void WriteByte(uint8_t address, uint8_t data)
+{
+  const char tx[2] = {(char)address, (char)data};
+  cs = 0;
+  gyroscope.write(tx, 2, nullptr, 0); // one block transfer instead of two byte transfers
+  cs = 1;
+}
+
+// Read I/O
+uint8_t ReadByte(uint8_t address)
 {
   cs = 0;
-  gyroscope.write(address);
-  gyroscope.write(data);
+  gyroscope.write(address | 0x80);
+  uint8_t data = gyroscope.write(0xff);
   cs = 1;
+  return data;
 }
 
 // Get raw data from gyroscope
@@ -61,34 +89,370 @@ void GetGyroValue(Gyroscope_RawData *rawdata)
   cs = 1;
 }
 
+// Enable FIFO stream mode
+// The FIFO keeps the latest 32 samples at the full ODR and the watermark is routed to INT2 (conf3 = INT2_WTM)
+void EnableFifoStream(uint8_t watermark)
+{
+  WriteByte(FIFO_CTRL_REG, FIFO_MODE_BYPASS); // bypass first to flush stale samples
+  WriteByte(CTRL_REG_5, FIFO_ENABLE);
+  WriteByte(FIFO_CTRL_REG, FIFO_MODE_STREAM | (watermark & FIFO_WTM_MASK));
+}
+
+// Disable FIFO, the output registers hold the latest sample again
+void DisableFifoStream()
+{
+  WriteByte(FIFO_CTRL_REG, FIFO_MODE_BYPASS);
+  WriteByte(CTRL_REG_5, 0x00);
+}
+
+// Switch the DR and BW bits of CTRL_REG_1, e.g. to a lower rate while waiting for motion
+void SetOutputDataRate(uint8_t conf1)
+{
+  WriteByte(CTRL_REG_1, conf1 | POWERON);
+}
+
+// Configure the threshold interrupt generator on INT1
+// All three axes share the threshold, the interrupt is latched until ClearMotionInterrupt
+void EnableMotionInterrupt(uint16_t threshold, uint8_t duration)
+{
+  uint8_t threshold_h = (threshold & INT1_TSH_MASK) >> 8;
+  uint8_t threshold_l = threshold & 0xff;
+
+  WriteByte(INT1_TSH_XH, threshold_h);
+  WriteByte(INT1_TSH_XL, threshold_l);
+  WriteByte(INT1_TSH_YH, threshold_h);
+  WriteByte(INT1_TSH_YL, threshold_l);
+  WriteByte(INT1_TSH_ZH, threshold_h);
+  WriteByte(INT1_TSH_ZL, threshold_l);
+  WriteByte(INT1_DURATION, INT1_WAIT | (duration & INT1_DURATION_MASK));
+  WriteByte(INT1_CFG, INT1_CFG_LIR | INT1_ZHIE | INT1_YHIE | INT1_XHIE);
+  ReadByte(INT1_SRC); // drop a stale latched event
+  WriteByte(CTRL_REG_3, ReadByte(CTRL_REG_3) | INT1_ENB);
+}
+
+// Route nothing to INT1 anymore
+void DisableMotionInterrupt()
+{
+  WriteByte(CTRL_REG_3, ReadByte(CTRL_REG_3) & ~INT1_ENB);
+  WriteByte(INT1_CFG, 0x00);
+  ReadByte(INT1_SRC);
+}
+
+// reading INT1_SRC clears the latched request
+uint8_t ClearMotionInterrupt()
+{
+  return ReadByte(INT1_SRC);
+}
+
+// Get the number of queued samples from the FIFO status register
+uint8_t GetFifoLevel()
+{
+  uint8_t fifo_src = ReadByte(FIFO_SRC_REG);
+
+  if (fifo_src & FIFO_SRC_OVRN)
+  {
+    fifo_overruns++;
+    return FIFO_DEPTH;
+  }
+  if (fifo_src & FIFO_SRC_EMPTY)
+  {
+    return 0;
+  }
+  return fifo_src & FIFO_SRC_FSS_MASK;
+}
+
+// Read all queued samples in one chip-select window
+// With the FIFO enabled the auto-incremented address rolls back from OUT_Z_H to OUT_X_L,
+// so every 6 bytes clocked out pop one sample
+uint8_t ReadFifoBurst(Gyroscope_RawData *samples, uint8_t max_samples)
+{
+  uint8_t count = GetFifoLevel();
+
+  if (count > max_samples)
+    count = max_samples;
+
+  cs = 0;
+  gyroscope.write(OUT_X_L | 0x80 | 0x40); // auto-incremented read
+  for (uint8_t i = 0; i < count; i++)
+  {
+    samples[i].x_raw = gyroscope.write(0xff) | gyroscope.write(0xff) << 8;
+    samples[i].y_raw = gyroscope.write(0xff) | gyroscope.write(0xff) << 8;
+    samples[i].z_raw = gyroscope.write(0xff) | gyroscope.write(0xff) << 8;
+  }
+  cs = 1;
+
+  return count;
+}
+
+// Unpack the bytes of a burst into samples, skipping the address byte
+void UnpackBurst(const uint8_t *rx, Gyroscope_SampleBlock *block)
+{
+  rx++;
+  for (uint8_t i = 0; i < block->count; i++, rx += 6)
+  {
+    block->samples[i].x_raw = rx[0] | rx[1] << 8;
+    block->samples[i].y_raw = rx[2] | rx[3] << 8;
+    block->samples[i].z_raw = rx[4] | rx[5] << 8;
+  }
+}
+
+// SPI event callback, runs in interrupt context
+void OnBurstComplete(int event)
+{
+  cs = 1;
+  Gyroscope_SampleBlock *block = &sample_blocks[active_block];
+  UnpackBurst(burst_rx[active_block], block);
+  active_block ^= 1; // the next burst fills the other half
+  transfer_busy = false;
+  if (transfer_complete)
+    transfer_complete(block);
+}
+
+// Start a burst read without blocking the CPU
+// The transfer is driven by the SPI peripheral while the caller keeps processing the previous block
+bool ReadFifoBurstAsync(uint8_t count, void (*on_complete)(const Gyroscope_SampleBlock *block))
+{
+  if (transfer_busy)
+    return false;
+
+  if (count > FIFO_DEPTH)
+    count = FIFO_DEPTH;
+
+  int length = 1 + count * 6;
+  burst_tx[0] = OUT_X_L | 0x80 | 0x40; // auto-incremented read
+  memset(burst_tx + 1, 0xff, length - 1);
+  sample_blocks[active_block].count = count;
+  sample_blocks[active_block].timestamp = CycleCounterRead();
+  transfer_complete = on_complete;
+  transfer_busy = true;
+
+  cs = 0;
+#if DEVICE_SPI_ASYNCH
+  if (gyroscope.transfer(burst_tx, length, burst_rx[active_block], length, callback(OnBurstComplete), SPI_EVENT_COMPLETE) != 0)
+  {
+    cs = 1;
+    transfer_busy = false;
+    return false;
+  }
+#else
+  // no asynchronous SPI on this target, fall back to one blocking block transfer
+  gyroscope.write((const char *)burst_tx, length, (char *)burst_rx[active_block], length);
+  OnBurstComplete(0);
+#endif
+  return true;
+}
+
+// check if an asynchronous burst is in flight
+bool IsGyroTransferBusy()
+{
+  return transfer_busy;
+}
+
+// Give up on a burst that never completed and release the bus
+void AbortGyroTransfer()
+{
+#if DEVICE_SPI_ASYNCH
+  gyroscope.abort_transfer();
+#endif
+  cs = 1;
+  transfer_busy = false;
+}
+
+// number of bursts that found the FIFO overrun
+uint32_t GetFifoOverrunCount()
+{
+  return fifo_overruns;
+}
+
+// Fold one sample into the running statistics of an axis
+// Once the window is full the count stops growing, so older samples fade out and the estimate follows drift
+void FoldBiasSample(Gyroscope_AxisStats *stats, float x)
+{
+  if (stats->count < BIAS_WINDOW)
+    stats->count++;
+  else
+    stats->m2 -= stats->m2 / BIAS_WINDOW;
+
+  float delta = x - stats->mean;
+  stats->mean += delta / stats->count;
+  stats->m2 += delta * (x - stats->mean);
+}
+
+// Forget the zero-rate estimate
+void ResetBiasEstimate()
+{
+  for (int axis = 0; axis < 3; axis++)
+  {
+    bias_stats[axis].count = 0;
+    bias_stats[axis].mean = 0.0f;
+    bias_stats[axis].m2 = 0.0f;
+  }
+}
+
+// Temperature bucket of an OUT_TEMP reading, rounded towards minus infinity so 0 is not twice as wide
+int8_t TemperatureBucket(int8_t temperature)
+{
+  return temperature >= 0 ? temperature / TEMP_BUCKET_WIDTH : -((TEMP_BUCKET_WIDTH - 1 - temperature) / TEMP_BUCKET_WIDTH);
+}
+
+// Cache entry a temperature bucket maps to
+Gyroscope_CalibrationEntry *CalibrationEntry(int8_t bucket)
+{
+  return &calibration_cache[(uint8_t)bucket % TEMP_CACHE_SIZE];
+}
+
+// Turn the statistics into the zero-rate levels and thresholds used by CalibrateRawData
+// and remember them for the current temperature bucket
+// Until the bucket holds BIAS_READY_COUNT samples the previous levels stay in use
+void ApplyBiasEstimate()
+{
+  if (!IsBiasEstimateReady())
+    return;
+
+  int16_t *levels[3] = {&x_sample, &y_sample, &z_sample};
+  int16_t *thresholds[3] = {&x_threshold, &y_threshold, &z_threshold};
+  Gyroscope_CalibrationEntry *entry = CalibrationEntry(temperature_bucket);
+
+  for (int axis = 0; axis < 3; axis++)
+  {
+    const Gyroscope_AxisStats *stats = &bias_stats[axis];
+    float variance = stats->count > 1 ? stats->m2 / (stats->count - 1) : 0.0f;
+    *levels[axis] = (int16_t)lroundf(stats->mean);
+    *thresholds[axis] = (int16_t)ceilf(NOISE_SIGMAS * sqrtf(variance));
+    entry->level[axis] = *levels[axis];
+    entry->threshold[axis] = *thresholds[axis];
+  }
+  entry->bucket = temperature_bucket;
+  entry->valid = true;
+}
+
+// Load a cached calibration and reseed the running statistics from it,
+// so the background estimate continues from the cached level instead of from scratch
+void LoadCalibrationEntry(const Gyroscope_CalibrationEntry *entry)
+{
+  int16_t *levels[3] = {&x_sample, &y_sample, &z_sample};
+  int16_t *thresholds[3] = {&x_threshold, &y_threshold, &z_threshold};
+
+  for (int axis = 0; axis < 3; axis++)
+  {
+    float sigma = entry->threshold[axis] / NOISE_SIGMAS;
+    *levels[axis] = entry->level[axis];
+    *thresholds[axis] = entry->threshold[axis];
+    bias_stats[axis].count = BIAS_READY_COUNT;
+    bias_stats[axis].mean = entry->level[axis];
+    bias_stats[axis].m2 = sigma * sigma * (BIAS_READY_COUNT - 1);
+  }
+}
+
+// Fold a block into the estimate if the board was still during the whole block
+// A flat block can still be a slow constant rotation, so the block mean has to stay near the zero-rate level in use;
+// after a bucket change that is still the previous bucket's level until the new estimate is ready, so the check never lapses
+bool UpdateBiasEstimate(const Gyroscope_RawData *samples, uint8_t count)
+{
+  if (count < STILL_BLOCK_MIN)
+    return false;
+
+  // peak-to-peak range and sum of each axis over the block
+  int16_t min_x = samples[0].x_raw, max_x = min_x;
+  int16_t min_y = samples[0].y_raw, max_y = min_y;
+  int16_t min_z = samples[0].z_raw, max_z = min_z;
+  int32_t sum[3] = {samples[0].x_raw, samples[0].y_raw, samples[0].z_raw};
+  for (uint8_t i = 1; i < count; i++)
+  {
+    min_x = min(min_x, samples[i].x_raw);
+    max_x = max(max_x, samples[i].x_raw);
+    min_y = min(min_y, samples[i].y_raw);
+    max_y = max(max_y, samples[i].y_raw);
+    min_z = min(min_z, samples[i].z_raw);
+    max_z = max(max_z, samples[i].z_raw);
+    sum[0] += samples[i].x_raw;
+    sum[1] += samples[i].y_raw;
+    sum[2] += samples[i].z_raw;
+  }
+  if (max_x - min_x > STILL_RANGE || max_y - min_y > STILL_RANGE || max_z - min_z > STILL_RANGE)
+    return false; // moving
+
+  const int16_t levels[3] = {x_sample, y_sample, z_sample};
+  for (int axis = 0; axis < 3; axis++)
+  {
+    if (fabsf((float)sum[axis] / count - levels[axis]) > STILL_OFFSET)
+      return false; // turning slowly
+  }
+
+  for (uint8_t i = 0; i < count; i++)
+  {
+    FoldBiasSample(&bias_stats[0], samples[i].x_raw);
+    FoldBiasSample(&bias_stats[1], samples[i].y_raw);
+    FoldBiasSample(&bias_stats[2], samples[i].z_raw);
+  }
+  ApplyBiasEstimate();
+  return true;
+}
+
+// read the temperature register
+int8_t ReadTemperature()
+{
+  return (int8_t)ReadByte(OUT_TEMP);
+}
+
+// Follow the temperature, the zero-rate level drifts with it
+// On a bucket change the cached calibration of the new bucket is loaded if there is one,
+// otherwise the background estimate starts over so the new bucket only gets samples taken at its temperature
+void SetGyroTemperature(int8_t temperature)
+{
+  int8_t bucket = TemperatureBucket(temperature);
+  if (bucket == temperature_bucket)
+    return;
+
+  temperature_bucket = bucket;
+  const Gyroscope_CalibrationEntry *entry = CalibrationEntry(bucket);
+  if (entry->valid && entry->bucket == bucket)
+    LoadCalibrationEntry(entry);
+  else
+    ResetBiasEstimate();
+}
+
+// check if the background estimate can be used instead of a blocking calibration
+bool IsBiasEstimateReady()
+{
+  return bias_stats[0].count >= BIAS_READY_COUNT &&
+         bias_stats[1].count >= BIAS_READY_COUNT &&
+         bias_stats[2].count >= BIAS_READY_COUNT;
+}
+
 // Calibrate gyroscope before recording
 // Find the "turn-on" zero rate level
 // Set up thresholds for three axes
 // Data below the corresponding threshold will be treated as zero to offset random vibrations when walking
+// Only needed on a cold start, afterwards UpdateBiasEstimate keeps the levels fresh in the background
 void CalibrateGyroscope(Gyroscope_RawData *rawdata)
 {
-  int16_t sumX = 0;
-  int16_t sumY = 0;
-  int16_t sumZ = 0;
   printf("========[Calibrating...]========\r\n");
-  for (int i = 0; i < 128; i++)
+  ResetBiasEstimate();
+  for (int i = 0; i < BIAS_READY_COUNT; i++)
   {
     GetGyroValue(rawdata);
-    sumX += rawdata->x_raw;
-    sumY += rawdata->y_raw;
-    sumZ += rawdata->z_raw;
-    x_threshold = max(x_threshold, rawdata->x_raw);
-    y_threshold = max(y_threshold, rawdata->y_raw);
-    z_threshold = max(z_threshold, rawdata->z_raw);
+    FoldBiasSample(&bias_stats[0], rawdata->x_raw);
+    FoldBiasSample(&bias_stats[1], rawdata->y_raw);
+    FoldBiasSample(&bias_stats[2], rawdata->z_raw);
     wait_us(10000);
   }
-
-  x_sample = sumX >> 7; // 128 is 2^7
-  y_sample = sumY >> 7;
-  z_sample = sumZ >> 7;
+  ApplyBiasEstimate();
   printf("========[Calibration finish.]========\r\n");
 }
 
+// Read back the configuration, a brown-out or a reset of the sensor brings back the power-on defaults
+bool CheckGyroscopeSession(const Gyroscope_Init_Parameters *init_parameters)
+{
+  uint8_t who_am_i = ReadByte(WHO_AM_I);
+  if (who_am_i != WHO_AM_I_L3GD20 && who_am_i != WHO_AM_I_L3GD20H)
+    return false;
+
+  return ReadByte(CTRL_REG_1) == (init_parameters->conf1 | POWERON) &&
+         (ReadByte(CTRL_REG_3) & ~INT1_ENB) == init_parameters->conf3 && // INT1 is armed on demand
+         ReadByte(CTRL_REG_4) == init_parameters->conf4;
+}
+
 // Initiate gyroscope, set up control registers
 void InitiateGyroscope(Gyroscope_Init_Parameters *init_parameters, Gyroscope_RawData *init_raw_data)
 {
@@ -98,6 +462,12 @@ void InitiateGyroscope(Gyroscope_Init_Parameters *init_parameters, Gyroscope_Raw
   // set up gyroscope
   gyroscope.format(8, 3);       // 8 bits per SPI frame; polarity 1, phase 0
   gyroscope.frequency(1000000); // clock frequency deafult 1 MHz max:10MHz
+#if DEVICE_SPI_ASYNCH
+  gyroscope.set_dma_usage(DMA_USAGE_OPPORTUNISTIC); // let asynchronous bursts use DMA when a channel is free
+#endif
+
+  // the sensor keeps its registers over an MCU reset, make sure the FIFO is not left streaming
+  DisableFifoStream();
 
   WriteByte(CTRL_REG_1, init_parameters->conf1 | POWERON); // set ODR Bandwidth and enable all 3 axises
   WriteByte(CTRL_REG_3, init_parameters->conf3);           // DRDY enable
@@ -122,10 +492,31 @@ void InitiateGyroscope(Gyroscope_Init_Parameters *init_parameters, Gyroscope_Raw
     break;
   }
 
-  CalibrateGyroscope(gyro_raw); // calibrate the gyroscope and find the threshold for x, y, and z.
+  // warm start from the calibration cache if this temperature was seen before
+  temperature_bucket = TemperatureBucket(ReadTemperature());
+  const Gyroscope_CalibrationEntry *entry = CalibrationEntry(temperature_bucket);
+  if (entry->valid && entry->bucket == temperature_bucket)
+    LoadCalibrationEntry(entry);
+  else
+    CalibrateGyroscope(gyro_raw); // calibrate the gyroscope and find the threshold for x, y, and z.
   printf("========[Initiation finish.]========\r\n");
 }
 
+// output data rate in Hz, DR bits of CTRL_REG_1
+uint16_t GetOutputDataRate(const Gyroscope_Init_Parameters *init_parameters)
+{
+  return 100 << (init_parameters->conf1 >> 6); // 100, 200, 400, 800 Hz
+}
+
+// decimation factor from the ODR to the matching rate, at least 1
+uint8_t GetDecimationFactor(const Gyroscope_Init_Parameters *init_parameters)
+{
+  uint16_t odr = GetOutputDataRate(init_parameters);
+  if (init_parameters->match_rate == 0 || init_parameters->match_rate >= odr)
+    return 1;
+  return odr / init_parameters->match_rate;
+}
+
 // convert raw data to dps
 float ConvertToDPS(int16_t axis_data)
 {
@@ -140,35 +531,34 @@ float ConvertToVelocity(int16_t axis_data)
   return velocity;
 }
 
-// Calculate distance from raw data array;
-float GetDistance(int16_t arr[])
+// sensitivity of the selected full scale, for integrating the rates (see OrientationIntegrator)
+float GetSensitivity()
 {
-  float distance = 0.00f;
-  for (int i = 0; i < 400; i++)
-  {
-    float v = ConvertToVelocity(arr[i]);
-    distance += abs(v * 0.05f);
-  }
-  return distance;
+  return sensitivity;
 }
 
 // convert raw data to calibrated data directly
 void GetCalibratedRawData()
 {
   GetGyroValue(gyro_raw);
+  CalibrateRawData(gyro_raw);
+}
 
+// offset and threshold a raw sample, e.g. one read from the FIFO
+void CalibrateRawData(Gyroscope_RawData *rawdata)
+{
   // offset the zero rate level
-  gyro_raw->x_raw -= x_sample;
-  gyro_raw->y_raw -= y_sample;
-  gyro_raw->z_raw -= z_sample;
+  rawdata->x_raw -= x_sample;
+  rawdata->y_raw -= y_sample;
+  rawdata->z_raw -= z_sample;
 
   // put data below threshold to zero
-  if (abs(gyro_raw->x_raw) < abs(x_threshold))
-    gyro_raw->x_raw = 0;
-  if (abs(gyro_raw->y_raw) < abs(y_threshold))
-    gyro_raw->y_raw = 0;
-  if (abs(gyro_raw->z_raw) < abs(z_threshold))
-    gyro_raw->z_raw = 0;
+  if (abs(rawdata->x_raw) < abs(x_threshold))
+    rawdata->x_raw = 0;
+  if (abs(rawdata->y_raw) < abs(y_threshold))
+    rawdata->y_raw = 0;
+  if (abs(rawdata->z_raw) < abs(z_threshold))
+    rawdata->z_raw = 0;
 }
 
 // turn off the gyroscope
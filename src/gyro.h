@@ -23,6 +23,8 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
+#pragma once // drivers/gyro.h already uses the __GYRO_H guard
+
 #include <mbed.h>
 
 // Register addresses
@@ -34,6 +36,7 @@ SOFTWARE.
 #define CTRL_REG_4 0x23 // control register 4
 #define CTRL_REG_5 0x24 // control register 5
 
+#define OUT_TEMP 0x26 // temperature data, -1 LSB/degC with an uncalibrated offset
 #define STATUS_REG 0x27 // status register
 
 #define OUT_X_L 0x28 // X-axis angular rate data Low
@@ -84,6 +87,12 @@ SOFTWARE.
 #define INT1_ACT 0x20 // Interrupt active configuration on INT1 pin
 #define INT1_OPEN 0x10 // INT1 pin configuration
 #define INT1_LATCH 0x02 // Latch interrupt request on INT1_SRC register
+#define INT1_CFG_AND 0x80 // INT1_CFG: AND combination of the enabled events (OR when cleared)
+#define INT1_CFG_LIR 0x40 // INT1_CFG: latch the request until INT1_SRC is read
+#define INT1_SRC_IA 0x40 // INT1_SRC: interrupt active
+#define INT1_WAIT 0x80 // INT1_DURATION: wait for the duration before clearing the interrupt
+#define INT1_DURATION_MASK 0x7f // INT1_DURATION: duration in ODR samples
+#define INT1_TSH_MASK 0x7fff // 15-bit threshold in raw counts
 #define INT1_ZHIE 0x20 // Enable interrupt generation on Z high event
 #define INT1_ZLIE 0x10 // Enable interrupt generation on Z low event
 #define INT1_YHIE 0x08 // Enable interrupt generation on Y high event
@@ -91,6 +100,20 @@ SOFTWARE.
 #define INT1_XHIE 0x02 // Enable interrupt generation on X high event
 #define INT1_XLIE 0x01 // Enable interrupt generation on X low event
 #define INT2_DRDY 0x08 // Data ready on DRDY/INT2 pin
+#define INT2_WTM 0x04 // FIFO watermark interrupt on DRDY/INT2 pin
+#define INT2_ORUN 0x02 // FIFO overrun interrupt on DRDY/INT2 pin
+
+// FIFO configurations
+#define FIFO_ENABLE 0x40 // FIFO enable bit in CTRL_REG_5
+#define FIFO_MODE_BYPASS 0x00 // FIFO_CTRL_REG: bypass mode
+#define FIFO_MODE_FIFO 0x20 // FIFO_CTRL_REG: stop collecting when full
+#define FIFO_MODE_STREAM 0x40 // FIFO_CTRL_REG: overwrite oldest sample when full
+#define FIFO_WTM_MASK 0x1f // FIFO_CTRL_REG: watermark level bits
+#define FIFO_SRC_WTM 0x80 // FIFO_SRC_REG: watermark level reached
+#define FIFO_SRC_OVRN 0x40 // FIFO_SRC_REG: FIFO is full and samples are being overwritten
+#define FIFO_SRC_EMPTY 0x20 // FIFO_SRC_REG: FIFO is empty
+#define FIFO_SRC_FSS_MASK 0x1f // FIFO_SRC_REG: number of unread samples
+#define FIFO_DEPTH 32 // FIFO depth in samples
 
 // Fullscale selections
 #define FULL_SCALE_245 0x00      // full scale 245 dps
@@ -110,6 +133,21 @@ SOFTWARE.
 #define POWERON 0x0f  // turn gyroscope
 #define POWEROFF 0x00 // turnoff gyroscope
 
+// Zero-rate level estimation
+#define BIAS_READY_COUNT 128 // samples before the estimate can replace the blocking calibration
+#define BIAS_WINDOW 2048     // the estimate forgets old samples once it holds this many
+#define STILL_BLOCK_MIN 8    // minimum samples in a block to judge if the board is still
+#define STILL_RANGE 64       // max peak-to-peak raw counts of a still block (~1.1 dps at 500 dps)
+#define STILL_OFFSET 16      // max distance of a still block's mean from the current level (~0.28 dps at 500 dps)
+#define NOISE_SIGMAS 5.0f    // calibration threshold in standard deviations of the zero-rate noise
+
+// Calibration cache
+#define TEMP_CACHE_SIZE 16   // direct-mapped entries
+#define TEMP_BUCKET_WIDTH 2  // OUT_TEMP LSB (~degC) per temperature bucket
+
+#define WHO_AM_I_L3GD20 0xD4  // WHO_AM_I of the L3GD20
+#define WHO_AM_I_L3GD20H 0xD7 // WHO_AM_I of the L3GD20H on newer boards
+
 #define SAMPLE_TIME_20 20
 #define SAMPLE_INTERVAL_0_05 0.005f
 
@@ -119,6 +157,7 @@ typedef struct
     uint8_t conf1;       // output data rate
     uint8_t conf3;       // interrupt configuration
     uint8_t conf4;       // full sacle selection
+    uint16_t match_rate; // rate in Hz after decimation, the rate the matcher sees
 } Gyroscope_Init_Parameters;
 
 // Raw data
@@ -137,29 +176,127 @@ typedef struct
     int16_t z_calibrated; // Z-axis calibrated data
 } Gyroscope_CalibratedData;
 
+// Running zero-rate statistics of one axis (Welford mean/variance)
+typedef struct
+{
+    uint32_t count; // samples folded in, capped at BIAS_WINDOW
+    float mean;     // zero-rate level in raw counts
+    float m2;       // sum of squared deviations from the mean
+} Gyroscope_AxisStats;
+
+// Zero-rate levels and thresholds calibrated at one temperature bucket
+typedef struct
+{
+    bool valid;
+    int8_t bucket;        // OUT_TEMP / TEMP_BUCKET_WIDTH rounded down, the entry was calibrated at
+    int16_t level[3];     // X, Y, Z zero-rate level
+    int16_t threshold[3]; // X, Y, Z threshold
+} Gyroscope_CalibrationEntry;
+
+// Block of samples filled by an asynchronous FIFO burst read
+typedef struct
+{
+    Gyroscope_RawData samples[FIFO_DEPTH]; // samples in FIFO order
+    uint8_t count;                         // number of valid samples
+    uint32_t timestamp;                    // DWT cycle count when the burst started, i.e. of the newest sample
+} Gyroscope_SampleBlock;
+
+// Raw sample with its DWT cycle count timestamp
+typedef struct
+{
+    Gyroscope_RawData data;
+    uint32_t timestamp;
+} Gyroscope_TimedSample;
+
 // Write IO
 void WriteByte(uint8_t address, uint8_t data);
 
+// Read IO
+uint8_t ReadByte(uint8_t address);
+
 // Read IO
 void GetGyroValue(Gyroscope_RawData *rawdata);
 
+// Put the FIFO in stream mode and raise the watermark interrupt on INT2 once `watermark` samples are queued
+void EnableFifoStream(uint8_t watermark);
+
+// Put the FIFO back in bypass mode
+void DisableFifoStream();
+
+// Switch to the output data rate and bandwidth of `conf1`, the rest of the configuration stays
+void SetOutputDataRate(uint8_t conf1);
+
+// Burst-read up to `max_samples` queued samples in one chip-select window, returns the number of samples read
+uint8_t ReadFifoBurst(Gyroscope_RawData *samples, uint8_t max_samples);
+
+// Raise INT1 once any axis exceeds `threshold` raw counts for `duration` samples
+void EnableMotionInterrupt(uint16_t threshold, uint8_t duration);
+
+// Stop raising INT1 on motion
+void DisableMotionInterrupt();
+
+// Read INT1_SRC, which also clears a latched motion interrupt
+uint8_t ClearMotionInterrupt();
+
+// Number of samples queued in the FIFO
+uint8_t GetFifoLevel();
+
+// Start a non-blocking burst read of `count` samples into one half of a double buffer
+// `on_complete` is called from interrupt context with the filled block, which stays valid until the next transfer completes
+// Returns false if the previous transfer is still in flight
+bool ReadFifoBurstAsync(uint8_t count, void (*on_complete)(const Gyroscope_SampleBlock *block));
+
+// Check if an asynchronous burst read is in flight, blocking reads must not be issued meanwhile
+bool IsGyroTransferBusy();
+
+// Abort an asynchronous burst that did not complete, its samples are dropped
+void AbortGyroTransfer();
+
+// Number of bursts that found the FIFO overrun (samples lost)
+uint32_t GetFifoOverrunCount();
+
 // Gyroscope calibration
 void CalibrateGyroscope(Gyroscope_RawData *rawdata);
 
+// Feed uncalibrated samples, blocks where the board is still refresh the zero-rate level and thresholds
+// Returns true if the block was still
+bool UpdateBiasEstimate(const Gyroscope_RawData *samples, uint8_t count);
+
+// Check if the background estimate holds enough still samples to skip the blocking calibration
+bool IsBiasEstimateReady();
+
+// Read the raw OUT_TEMP register
+int8_t ReadTemperature();
+
+// Report the current temperature, switching to the cached calibration of its bucket if there is one
+void SetGyroTemperature(int8_t temperature);
+
+// Check that the sensor still holds the configuration written by InitiateGyroscope
+bool CheckGyroscopeSession(const Gyroscope_Init_Parameters *init_parameters);
+
 // Gyroscope initialization
 void InitiateGyroscope(Gyroscope_Init_Parameters *init_parameters, Gyroscope_RawData *init_raw_data);
 
+// Output data rate in Hz selected by conf1
+uint16_t GetOutputDataRate(const Gyroscope_Init_Parameters *init_parameters);
+
+// Decimation factor from the output data rate down to the matching rate
+uint8_t GetDecimationFactor(const Gyroscope_Init_Parameters *init_parameters);
+
 // Data conversion: raw -> dps
 float ConvertToDPS(int16_t rawdata);
 
 // Data conversion: dps -> m/s
 float ConvertToVelocity(int16_t rawdata);
 
-// Calculate distance from raw data array;
-float GetDistance(int16_t arr[]);
+// Sensitivity of the selected full scale in dps per count
+float GetSensitivity();
 
 // Get calibrated data
 void GetCalibratedRawData();
 
+// Offset and threshold a raw sample in place
+void CalibrateRawData(Gyroscope_RawData *rawdata);
+
 // Turn off the gyroscope
 void PowerOff();
\ No newline at end of file
@@ -5,6 +5,18 @@
 #include <cmath>
 #include <math.h>
 #include "gyro.h"
+#include "benchmark.h"
+#include "ring_buffer.h"
+#include "gesture.h"
+#include "decimator.h"
+#include "cycle_counter.h"
+#include "sample_timing.h"
+#include "online_match.h"
+#include "endpoint_detector.h"
+#include "template_average.h"
+#include "sax_index.h"
+#include "orientation.h"
+#include "filter_stages.h"
 #include "drivers/LCD_DISCO_F429ZI.h"
 #include "drivers/TS_DISCO_F429ZI.h"
 
@@ -13,6 +25,39 @@
 #define UNLOCK_FLAG 2
 #define ERASE_FLAG 4
 #define DATA_READY_FLAG 8
+#define GYRO_BLOCK_FLAG 16
+#define MOTION_FLAG 32
+#define GYRO_BUS_FLAG 64 // a burst finished, only wait_for_gyro_bus waits for it
+
+// longest a FIFO burst may take before it is aborted, a full FIFO takes about 2 ms
+#define GYRO_BUS_TIMEOUT 10ms
+
+// longest wait for a watermark before INT2 is polled, above the 310 ms watermark period at ARMED_ODR
+#define GYRO_POLL_PERIOD 500ms
+
+// FIFO bursts between two temperature reads, ~1.3 s at the recording rate
+#define TEMPERATURE_BURSTS 16
+
+// FIFO watermark, number of samples queued before the gyroscope raises INT2
+#define FIFO_WATERMARK 16
+
+// Motion triggered recording, set to 0 to use the fixed countdown instead
+#define MOTION_TRIGGER 1
+#define MOTION_THRESHOLD 1700 // raw counts on any axis that start a gesture (~30 dps at 500 dps full scale)
+#define MOTION_DURATION 2     // samples at ARMED_ODR the threshold has to be exceeded for
+#define MOTION_TIMEOUT 10s    // start recording anyway if there is no motion
+#define PRETRIGGER_SIZE 32    // decimated samples kept before the trigger (power of two, 640 ms at 50 Hz)
+#define ARMED_ODR ODR_100_CUTOFF_25         // lowest ODR while waiting for motion, still 2x the matching rate
+#define ARMED_WATERMARK (FIFO_DEPTH - 1)    // wake up every 310 ms at ARMED_ODR instead of every 80 ms
+
+// Gesture endpoint detection, the recording ends once the motion stopped instead of after the full window
+#define ENDPOINT_OPEN_RMS 1000 // short-term RMS rate in raw counts that opens a gesture (~17.5 dps at 500 dps full scale)
+#define ENDPOINT_CLOSE_RMS 400 // short-term RMS rate below which the gesture may close (~7 dps)
+#define ENDPOINT_WINDOW 5      // short-term energy window in decimated samples, 100 ms at 50 Hz
+#define ENDPOINT_HANGOVER 25   // samples below the close level that end the gesture, 500 ms at 50 Hz
+
+// Capacity of the sample ring between the SPI callback and the gyroscope thread (power of two)
+#define SAMPLE_RING_SIZE 128
 
 //LCD font size
 #define FONT_SIZE 16
@@ -20,6 +65,49 @@
 // the unlocking threshold, change this to a smaller value if you have trouble unlocking (has to be positive)
 #define CORRELATION_THRESHOLD 0.3f
 
+// Unlock metrics
+#define METRIC_CORRELATION 0 // per-axis correlation above CORRELATION_THRESHOLD
+#define METRIC_DTW 1         // banded DTW distance below DTW_THRESHOLD
+#define METRIC_XCORR 2       // per-axis cross-correlation peak within XCORR_MAX_LAG above CORRELATION_THRESHOLD
+#define UNLOCK_METRIC METRIC_CORRELATION
+
+// resample key and attempt to CANONICAL_LENGTH before correlating, 0 correlates the samples both have (online)
+#define CORRELATION_RESAMPLE 1
+
+// the metrics that read online_matcher, the others do not feed it while recording
+#define ONLINE_MATCH (UNLOCK_METRIC == METRIC_DTW || (UNLOCK_METRIC == METRIC_CORRELATION && !CORRELATION_RESAMPLE))
+
+// look the resampled attempt up in the SAX index first, only the keys it returns are correlated
+// the lookup only pays off with many more keys than TEMPLATE_CAPACITY 4, below that the full scan is faster
+#define SAX_PREFILTER 0
+
+// largest start offset between key and attempt the cross-correlation tolerates, 0.5 s at 50 Hz
+#define XCORR_MAX_LAG (MATCH_RATE_HZ / 2)
+
+// what the matchers compare: the recorded rates, or the orientation integrated from them,
+// which depends on the path of the gesture rather than on how fast it was performed
+#define FEATURES_RATE 0        // calibrated angular rates
+#define FEATURES_QUATERNION 1  // vector part of the orientation quaternion, Q15
+#define FEATURES_ANGLE 2       // cumulative angle of each axis in ORIENTATION_ANGLE_STEP
+#define MATCH_FEATURES FEATURES_RATE
+
+// the DTW threshold in raw counts per warping step, change this to a larger value if you have trouble unlocking
+#define DTW_THRESHOLD 1500.0f
+#define DTW_BAND (RECORD_CAPACITY / 10) // half width of the warping window, 0.5 s at 50 Hz
+
+// repetitions of the gesture averaged into one key, each one has to be within DTW_THRESHOLD of the average so far
+#define ENROLL_REPETITIONS 3
+
+// filter stages between the decimator and the matchers: a median of 3 drops single-sample spikes,
+// the low-pass takes out the tremor above 10 Hz; 0 passes the decimated samples through
+#define GESTURE_FILTER 1
+#if GESTURE_FILTER
+typedef FilterChain<MedianFilter<3>, Biquad<BIQUAD_LOWPASS, 10, MATCH_RATE_HZ>> GestureFilter;
+#else
+typedef FilterChain<> GestureFilter;
+#endif
+
+InterruptIn gyro_int1(PA_1, PullDown);
 InterruptIn gyro_int2(PA_2, PullDown);
 InterruptIn user_button(USER_BUTTON, PullDown);
 
@@ -40,13 +128,15 @@ void draw_button(int x, int y, int width, int height, const char *label);
 bool is_touch_inside_button(int touch_x, int touch_y, int button_x, int button_y, int button_width, int button_height);
 
 /*******************************************************************************
- * Function Prototypes of data processing
+ * Function Prototypes of gyroscope sampling
  * ****************************************************************************/
-float euclidean_distance(const array<float, 3> &a, const array<float, 3> &b);
-float dtw(const vector<array<float, 3>> &s, const vector<array<float, 3>> &t);
-void trim_gyro_data(vector<array<float, 3>> &data);
-float correlation(const vector<float> &a, const vector<float> &b);
-array<float, 3> calculateCorrelationVectors(vector<array<float, 3>>& vec1, vector<array<float, 3>>& vec2);
+void service_gyro_fifo(uint32_t gyro_flags);
+void wait_for_gyro_bus();
+uint32_t wait_gyro_flags(uint32_t wanted, chrono::milliseconds timeout);
+size_t pop_sample_batch(Gyroscope_RawData *raw, uint32_t *timestamps);
+void drain_gesture_samples(CicDecimator<3> &decimator, bool armed);
+void append_gesture_sample(const GestureSample &sample, uint32_t timestamp);
+void switch_gyro_rate(const Gyroscope_Init_Parameters *parameters, uint8_t watermark, CicDecimator<3> &decimator);
 
 /*******************************************************************************
  * Function Prototypes of Threads
@@ -57,14 +147,8 @@ void touch_screen_thread();
 /*******************************************************************************
  * Function Prototypes of Flash
  * ****************************************************************************/
-bool storeGyroDataToFlash(vector<array<float, 3>> &gesture_key, uint32_t flash_address);
-vector<array<float, 3>> readGyroDataFromFlash(uint32_t flash_address, size_t data_size);
-
-/*******************************************************************************
- * Function Prototypes of filters
- * ****************************************************************************/
-// moving average filter will be defined after main()
-float movingAverageFilter(float input, float display_buffer[], size_t N, size_t &index, float &sum);
+bool storeGyroDataToFlash(GestureRecord &gesture_key, uint32_t flash_address);
+void readGyroDataFromFlash(GestureRecord &gesture_key, uint32_t flash_address, size_t data_size);
 
 /*******************************************************************************
  * ISR Callback Functions
@@ -73,16 +157,74 @@ void button_press() // Callback function for button press
 {
     flags.set(ERASE_FLAG);
 }
-void onGyroDataReady() // Gyrscope data ready ISR
+void onGyroMotion() // Gyroscope threshold ISR
+{
+    flags.set(MOTION_FLAG);
+}
+void onGyroDataReady() // Gyrscope FIFO watermark ISR
 {
     flags.set(DATA_READY_FLAG);
 }
+SpscRing<Gyroscope_TimedSample, SAMPLE_RING_SIZE> sample_ring; // raw samples from the SPI callback to the gyroscope thread
+uint32_t odr_period = 0; // nominal ODR period in DWT cycles
+uint32_t sample_clock = 0; // timestamp of the next FIFO sample on the sensor clock
+uint32_t clock_overruns = 0; // FIFO overrun count when sample_clock was last anchored
+volatile bool clock_anchored = false; // cleared whenever the FIFO is flushed
+uint32_t last_burst = 0; // DWT stamp of the previous burst
+uint32_t temperature_bursts = 0; // bursts until the temperature is read again
+SpscRing<BurstInterval, 8> burst_ring; // measured burst-to-burst intervals for the jitter statistics
+void onGyroBlockReady(const Gyroscope_SampleBlock *block) // Gyroscope burst transfer complete callback
+{
+    // the FIFO samples are uniform on the sensor clock, so they are stamped at the nominal ODR from one anchor on;
+    // only an overrun loses samples, then the clock is anchored again at the newest sample of the burst
+    uint32_t overruns = GetFifoOverrunCount();
+    if (!clock_anchored || overruns != clock_overruns)
+    {
+        sample_clock = block->timestamp - (uint32_t)(block->count - 1) * odr_period;
+        clock_overruns = overruns;
+        clock_anchored = true;
+    }
+    else
+    {
+        // the previous burst emptied the FIFO, so the samples of this one arrived since it started
+        BurstInterval interval = {block->timestamp - last_burst, (uint32_t)block->count * odr_period};
+        burst_ring.Push(interval);
+    }
+    last_burst = block->timestamp;
+    for (uint8_t i = 0; i < block->count; i++)
+    {
+        // a sample the ring drops still advances the clock, so the loss shows up as a gap
+        Gyroscope_TimedSample sample = {block->samples[i], sample_clock};
+        sample_ring.Push(sample);
+        sample_clock += odr_period;
+    }
+    flags.set(GYRO_BLOCK_FLAG | GYRO_BUS_FLAG);
+}
 
 /*******************************************************************************
  * @brief Global Variables
  * ****************************************************************************/
-vector<array<float, 3>> gesture_key; // the gesture key
-vector<array<float, 3>> unlocking_record; // the unlocking record
+TemplateStore gesture_keys; // the enrolled gesture keys and their envelopes
+MatchCascadeStats cascade_stats; // unlocking attempts decided at each matcher stage
+GestureRecord unlocking_record; // the unlocking record
+GestureAxes unlocking_axes; // the unlocking record per axis
+CanonicalAxes unlocking_canonical; // the unlocking record resampled to CANONICAL_LENGTH
+CanonicalStats unlocking_stats; // sums of unlocking_canonical, shared by every key it is correlated with
+GestureRecord temp_key; // temporary key to store the recording gyro data
+GestureTimes temp_key_time; // timestamps of the temp_key samples
+SpscRing<TimedGestureSample, PRETRIGGER_SIZE> pretrigger; // latest samples before the motion trigger
+SampleJitterStats jitter_stats; // burst-to-burst intervals of the current recording
+OnlineMatcher online_matcher; // scores the unlocking attempt while it is recorded
+bool online_matching = false; // feed the recorded samples into online_matcher
+bool online_valid = false; // online_matcher saw exactly the samples of unlocking_record
+uint32_t capture_end = 0; // cycle count at the end of the recording
+EndpointDetector endpoint; // opens and closes the gesture on the short-term energy
+TemplateAverage enrollment; // running average of the repetitions of the key being recorded
+#if SAX_PREFILTER
+SaxIndex key_index; // coarse SAX index of gesture_keys, rebuilt whenever they change
+#endif
+OrientationIntegrator orientation; // integrates the recorded rates into orientation features
+GestureFilter gesture_filter; // filters the decimated samples before the pre-trigger buffer and temp_key
 
 const int button1_x = 60;
 const int button1_y = 80;
@@ -102,13 +244,14 @@ const int text_y = 270;
 const char *text_0 = "NO KEY RECORDED";
 const char *text_1 = "LOCKED";
 
-int err = 0; // for error checking
-
 /*******************************************************************************
  * @brief main function
  * ****************************************************************************/
 int main()
 {
+    // the DWT cycle counter timestamps the gyroscope samples
+    CycleCounterInit();
+
     lcd.Clear(LCD_COLOR_BLACK);
 
     // Draw button 1
@@ -123,9 +266,15 @@ int main()
     // initialize all interrupts
     user_button.rise(&button_press);
     gyro_int2.rise(&onGyroDataReady);
+    gyro_int1.rise(&onGyroMotion);
+
+#if SAX_PREFILTER
+    // index whatever keys there are at boot
+    sax_index_build(key_index, gesture_keys);
+#endif
 
     // initialize LEDs
-    if (gesture_key.empty())
+    if (gesture_keys.empty())
     {
         red_led = 0;
         green_led = 1;
@@ -163,12 +312,23 @@ void gyroscope_thread()
     // Add your gyroscope initialization parameters here
     Gyroscope_Init_Parameters init_parameters;
     init_parameters.conf1 = ODR_200_CUTOFF_50;
-    init_parameters.conf3 = INT2_DRDY;
+    init_parameters.conf3 = INT2_WTM;
     init_parameters.conf4 = FULL_SCALE_500;
+    init_parameters.match_rate = MATCH_RATE_HZ;
+
+    // Decimate from the ODR down to the matching rate
+    CicDecimator<3> decimator;
 
     // Set up gyroscope's raw data
     Gyroscope_RawData raw_data;
 
+    // batch of samples drained from the sample ring
+    Gyroscope_RawData batch[FIFO_DEPTH];
+    uint32_t batch_time[FIFO_DEPTH];
+
+    odr_period = PeriodInCycles(GetOutputDataRate(&init_parameters));
+    uint32_t match_period = odr_period * GetDecimationFactor(&init_parameters);
+
     // initialize a string display_buffer that can be draw on the LCD to dispaly the status
     char display_buffer[50];
 
@@ -183,11 +343,35 @@ void gyroscope_thread()
         flags.set(DATA_READY_FLAG);
     }
 
+    // Initiate gyroscope once, the cold start calibration runs here
+    InitiateGyroscope(&init_parameters, &raw_data);
+
+#ifdef BENCHMARK_ENABLE
+    RunBenchmarks();
+#endif
+
+    // Keep the FIFO streaming, samples taken while idle keep the zero-rate level fresh
+    EnableFifoStream(FIFO_WATERMARK);
+
     while (1)
     {
-        vector<array<float, 3>> temp_key; // temporary key to store the recording gyro data
+        temp_key.clear(); // reuse the temporary key storage
 
-        auto flag_check = flags.wait_any(KEY_FLAG | UNLOCK_FLAG | ERASE_FLAG);
+        auto flag_check = flags.wait_any(KEY_FLAG | UNLOCK_FLAG | ERASE_FLAG | DATA_READY_FLAG | GYRO_BLOCK_FLAG);
+
+        // background zero-rate estimation
+        if (flag_check & (DATA_READY_FLAG | GYRO_BLOCK_FLAG))
+        {
+            service_gyro_fifo(flag_check);
+            while (pop_sample_batch(batch, batch_time) > 0)
+            {
+                // nothing to record, the batch only feeds the zero-rate estimate
+            }
+            if (!(flag_check & (KEY_FLAG | UNLOCK_FLAG | ERASE_FLAG)))
+            {
+                continue;
+            }
+        }
 
         if (flag_check & ERASE_FLAG)
         {
@@ -197,7 +381,11 @@ void gyroscope_thread()
             lcd.FillRect(0, text_y, lcd.GetXSize(), FONT_SIZE); // Clear a specific line
             lcd.SetTextColor(LCD_COLOR_BLUE);                   // Reset the text color
             lcd.DisplayStringAt(text_x, text_y, (uint8_t *)display_buffer, CENTER_MODE);
-            gesture_key.clear();
+            gesture_keys.clear();
+#if SAX_PREFILTER
+            sax_index_build(key_index, gesture_keys);
+#endif
+            template_average_reset(enrollment);
             
             // Erase the unlocking record
             sprintf(display_buffer, "Key Erasing finish.");
@@ -227,15 +415,85 @@ void gyroscope_thread()
 
             ThisThread::sleep_for(1s);
 
-            sprintf(display_buffer, "Calibrating...");
+            // no calibration needed, the zero-rate level is estimated in the background
+            // only re-initiate the gyroscope if it lost its configuration
+            wait_for_gyro_bus();
+            if (!CheckGyroscopeSession(&init_parameters))
+            {
+                printf("Gyroscope lost its configuration, re-initiating\r\n");
+                InitiateGyroscope(&init_parameters, &raw_data);
+                EnableFifoStream(FIFO_WATERMARK);
+                clock_anchored = false; // the FIFO was flushed
+            }
+
+            uint32_t fifo_overruns = GetFifoOverrunCount();
+            uint32_t ring_overruns = sample_ring.Overruns();
+            sample_ring.Clear(); // drop the samples queued while waiting
+            burst_ring.Clear();
+            decimator.Reset(GetDecimationFactor(&init_parameters));
+            gesture_filter.Reset();
+            temp_key_time.clear();
+            ResetJitterStats(&jitter_stats);
+            endpoint.Reset(ENDPOINT_OPEN_RMS, ENDPOINT_CLOSE_RMS, ENDPOINT_WINDOW, ENDPOINT_HANGOVER);
+
+            // score an unlocking attempt against the keys while it is being recorded
+            online_matching = ONLINE_MATCH && MATCH_FEATURES == FEATURES_RATE && (flag_check & UNLOCK_FLAG) && !gesture_keys.empty();
+            if (online_matching)
+            {
+                online_match_reset(online_matcher, gesture_keys, DTW_THRESHOLD);
+            }
+            // the FIFO may have filled up without a new edge on INT2
+            if (gyro_int2.read() == 1)
+            {
+                flags.set(DATA_READY_FLAG);
+            }
+
+#if MOTION_TRIGGER
+            // wait for the gyroscope's threshold interrupt, keep the latest samples so the onset is not lost
+            sprintf(display_buffer, "Move to record...");
             lcd.SetTextColor(LCD_COLOR_BLACK);                  // Set the color to the background color
             lcd.FillRect(0, text_y, lcd.GetXSize(), FONT_SIZE); // Clear a specific line
             lcd.SetTextColor(LCD_COLOR_BLUE);                   // Reset the text color
             lcd.DisplayStringAt(text_x, text_y, (uint8_t *)display_buffer, CENTER_MODE);
 
-            // Initiate gyroscope
-            InitiateGyroscope(&init_parameters, &raw_data);
-
+            // the threshold generator needs the sensor running, but at the lowest ODR and a full FIFO per wake-up
+            pretrigger.Clear();
+            Gyroscope_Init_Parameters armed_parameters = init_parameters;
+            armed_parameters.conf1 = ARMED_ODR;
+            switch_gyro_rate(&armed_parameters, ARMED_WATERMARK, decimator);
+            flags.clear(MOTION_FLAG);
+            EnableMotionInterrupt(MOTION_THRESHOLD, MOTION_DURATION);
+            timer.start();
+            while (timer.elapsed_time() < MOTION_TIMEOUT)
+            {
+                // the MCU sleeps until the next watermark or the motion interrupt, but not past the timeout
+                auto remaining = chrono::duration_cast<chrono::milliseconds>(MOTION_TIMEOUT - timer.elapsed_time());
+                auto gyro_flags = wait_gyro_flags(DATA_READY_FLAG | GYRO_BLOCK_FLAG | MOTION_FLAG, min(remaining, chrono::milliseconds(GYRO_POLL_PERIOD)));
+                service_gyro_fifo(gyro_flags);
+                drain_gesture_samples(decimator, true);
+                if (gyro_flags & MOTION_FLAG)
+                {
+                    break;
+                }
+            }
+            timer.stop();
+            timer.reset();
+            wait_for_gyro_bus();
+            DisableMotionInterrupt();
+
+            // the samples still in the FIFO are the last ones before the trigger, then back to the full rate
+            ReadFifoBurstAsync(GetFifoLevel(), onGyroBlockReady);
+            wait_for_gyro_bus();
+            drain_gesture_samples(decimator, true);
+            switch_gyro_rate(&init_parameters, FIFO_WATERMARK, decimator);
+
+            // the recording starts with the samples from before the trigger
+            TimedGestureSample pretrigger_sample;
+            while (pretrigger.Pop(pretrigger_sample))
+            {
+                append_gesture_sample(pretrigger_sample.sample, pretrigger_sample.timestamp);
+            }
+#else
             // start recording gesture
             sprintf(display_buffer, "Recording in 3...");
             lcd.SetTextColor(LCD_COLOR_BLACK);                  // Set the color to the background color
@@ -255,31 +513,74 @@ void gyroscope_thread()
             lcd.SetTextColor(LCD_COLOR_BLUE);                   // Reset the text color
             lcd.DisplayStringAt(text_x, text_y, (uint8_t *)display_buffer, CENTER_MODE);
             ThisThread::sleep_for(1s);
+            sample_ring.Clear(); // drop the samples queued during the countdown
+            burst_ring.Clear();
+#endif
 
             sprintf(display_buffer, "Recording...");
             lcd.SetTextColor(LCD_COLOR_BLACK);                  // Set the color to the background color
             lcd.FillRect(0, text_y, lcd.GetXSize(), FONT_SIZE); // Clear a specific line
             lcd.SetTextColor(LCD_COLOR_BLUE);                   // Reset the text color
             lcd.DisplayStringAt(text_x, text_y, (uint8_t *)display_buffer, CENTER_MODE);
-            
-            // gyro data recording loop
+
+            // gyro data recording loop, until the endpoint detector closed the gesture or the window is full
+            // the FIFO collects every sample at the full ODR, the thread only wakes up once per watermark
             timer.start();
-            while (timer.elapsed_time() < 5s)
+            while (timer.elapsed_time() < chrono::seconds(RECORD_WINDOW_S) && !temp_key.full() &&
+                   endpoint.GetState() != EndpointDetector::CLOSED)
             {
-                // Wait for the gyroscope data to be ready
-                flags.wait_all(DATA_READY_FLAG);
-                // Read the data from the gyroscope
-                GetCalibratedRawData();
-                // Add the converted data to the gesture_key vector
-                temp_key.push_back({ConvertToDPS(raw_data.x_raw), ConvertToDPS(raw_data.y_raw), ConvertToDPS(raw_data.z_raw)});
-                ThisThread::sleep_for(50ms); // 20Hz
+                // Wait for the FIFO watermark or a finished burst, but not past the end of the window
+                auto remaining = chrono::duration_cast<chrono::milliseconds>(chrono::seconds(RECORD_WINDOW_S) - timer.elapsed_time());
+                auto gyro_flags = wait_gyro_flags(DATA_READY_FLAG | GYRO_BLOCK_FLAG, min(remaining, chrono::milliseconds(GYRO_POLL_PERIOD)));
+                service_gyro_fifo(gyro_flags);
+                drain_gesture_samples(decimator, false);
             }
             timer.stop();  // Stop timer
             timer.reset(); // Reset timer
+            capture_end = CycleCounterRead();
+            online_valid = online_matching;
+            online_matching = false;
+            printf("Recorded %u samples, FIFO overruns: %lu, ring overruns: %lu\r\n", (unsigned)temp_key.size(),
+                   (unsigned long)(GetFifoOverrunCount() - fifo_overruns), (unsigned long)(sample_ring.Overruns() - ring_overruns));
+            PrintJitterStats(&jitter_stats);
+            if (endpoint.GetState() == EndpointDetector::CLOSED)
+            {
+                printf("Gesture from sample %u to %u\r\n", (unsigned)endpoint.OpenIndex(), (unsigned)endpoint.CloseIndex());
+            }
+            else
+            {
+                printf("Gesture did not close within the window\r\n");
+            }
+
+            // lost samples leave a gap in the sensor clock, a drifting sensor clock stretches the whole recording;
+            // interpolate onto a uniform grid in DWT time when either happened or a burst came far off its nominal interval
+            if (GetFifoOverrunCount() != fifo_overruns || sample_ring.Overruns() != ring_overruns || JitterExceedsBound(&jitter_stats))
+            {
+                ResampleUniform(temp_key, temp_key_time, DriftCorrectedPeriod(&jitter_stats, match_period));
+                online_valid = false; // the online matcher saw the samples before resampling
+                printf("Resampled to %u samples on a uniform grid\r\n", (unsigned)temp_key.size());
+            }
 
             // trim zeros
             trim_gyro_data(temp_key);
 
+#if MATCH_FEATURES != FEATURES_RATE || defined(BENCHMARK_ENABLE)
+            // integrate at the rate the samples are at after decimation
+            orientation.Reset(GetSensitivity(), GetOutputDataRate(&init_parameters) / GetDecimationFactor(&init_parameters));
+#if MATCH_FEATURES == FEATURES_RATE
+            // the matchers compare the rates, the orientation is only integrated for the diagnostic below
+            for (size_t i = 0; i < temp_key.size(); i++)
+            {
+                orientation.Process(temp_key[i]);
+            }
+#else
+            // the matchers compare the orientation features from here on
+            orientation.Integrate(temp_key, temp_key, MATCH_FEATURES == FEATURES_ANGLE ? OrientationIntegrator::FEATURE_ANGLE : OrientationIntegrator::FEATURE_QUATERNION);
+#endif
+            printf("Rotated %.1f degrees in %.2f s, %.2f m at the leg\r\n", orientation.TravelledAngle() * (180.0f / (float)M_PI),
+                   orientation.Duration(), orientation.TravelledAngle() * MY_LEG);
+#endif
+
             sprintf(display_buffer, "Finished...");
             lcd.SetTextColor(LCD_COLOR_BLACK);                  // Set the color to the background color
             lcd.FillRect(0, text_y, lcd.GetXSize(), FONT_SIZE); // Clear a specific line
@@ -290,58 +591,74 @@ void gyroscope_thread()
         // check the flag see if it is recording or unlocking
         if (flag_check & KEY_FLAG)
         {
-            if (gesture_key.empty())
+            if (temp_key.empty())
             {
-                sprintf(display_buffer, "Saving Key...");
+                sprintf(display_buffer, "No motion recorded.");
                 lcd.SetTextColor(LCD_COLOR_BLACK);                  // Set the color to the background color
                 lcd.FillRect(0, text_y, lcd.GetXSize(), FONT_SIZE); // Clear a specific line
                 lcd.SetTextColor(LCD_COLOR_BLUE);                   // Reset the text color
                 lcd.DisplayStringAt(text_x, text_y, (uint8_t *)display_buffer, CENTER_MODE);
-
-                // save the key
-                gesture_key = temp_key;
-
-                // clear temp_key
-                temp_key.clear();
-
-                // toggle led
-                red_led = 1;
-                green_led = 0;
-
-                sprintf(display_buffer, "Key saved...");
+            }
+            else if (!(template_average_add(enrollment, temp_key, DTW_BAND, DTW_THRESHOLD) <= DTW_THRESHOLD))
+            {
+                // too different from the repetitions so far, the average stays as it was
+                sprintf(display_buffer, "Not the same, again %u/%u", (unsigned)enrollment.count + 1, (unsigned)ENROLL_REPETITIONS);
                 lcd.SetTextColor(LCD_COLOR_BLACK);                  // Set the color to the background color
                 lcd.FillRect(0, text_y, lcd.GetXSize(), FONT_SIZE); // Clear a specific line
                 lcd.SetTextColor(LCD_COLOR_BLUE);                   // Reset the text color
                 lcd.DisplayStringAt(text_x, text_y, (uint8_t *)display_buffer, CENTER_MODE);
+                temp_key.clear();
             }
-            else
+            else if (enrollment.count < ENROLL_REPETITIONS)
             {
-                sprintf(display_buffer, "Removing old key...");
+                sprintf(display_buffer, "Repeat %u/%u...", (unsigned)enrollment.count + 1, (unsigned)ENROLL_REPETITIONS);
                 lcd.SetTextColor(LCD_COLOR_BLACK);                  // Set the color to the background color
                 lcd.FillRect(0, text_y, lcd.GetXSize(), FONT_SIZE); // Clear a specific line
                 lcd.SetTextColor(LCD_COLOR_BLUE);                   // Reset the text color
                 lcd.DisplayStringAt(text_x, text_y, (uint8_t *)display_buffer, CENTER_MODE);
+                temp_key.clear();
+            }
+            else
+            {
+                if (gesture_keys.full())
+                {
+                    sprintf(display_buffer, "Removing oldest key...");
+                    lcd.SetTextColor(LCD_COLOR_BLACK);                  // Set the color to the background color
+                    lcd.FillRect(0, text_y, lcd.GetXSize(), FONT_SIZE); // Clear a specific line
+                    lcd.SetTextColor(LCD_COLOR_BLUE);                   // Reset the text color
+                    lcd.DisplayStringAt(text_x, text_y, (uint8_t *)display_buffer, CENTER_MODE);
 
-                ThisThread::sleep_for(1s);
-                
-                // clear old key
-                gesture_key.clear();
+                    ThisThread::sleep_for(1s);
 
-                // save new key
-                gesture_key = temp_key;
+                    // drop the oldest key
+                    gesture_keys.erase(gesture_keys.begin(), gesture_keys.begin() + 1);
+                }
 
-                sprintf(display_buffer, "New key is saved.");
+                sprintf(display_buffer, "Saving Key %u...", (unsigned)gesture_keys.size());
                 lcd.SetTextColor(LCD_COLOR_BLACK);                  // Set the color to the background color
                 lcd.FillRect(0, text_y, lcd.GetXSize(), FONT_SIZE); // Clear a specific line
                 lcd.SetTextColor(LCD_COLOR_BLUE);                   // Reset the text color
                 lcd.DisplayStringAt(text_x, text_y, (uint8_t *)display_buffer, CENTER_MODE);
 
+                // enroll the average of the repetitions with its tolerance envelope
+                add_template_average(gesture_keys, enrollment, DTW_BAND);
+#if SAX_PREFILTER
+                sax_index_build(key_index, gesture_keys);
+#endif
+                template_average_reset(enrollment);
+
                 // clear temp_key
                 temp_key.clear();
 
                 // toggle led
                 red_led = 1;
                 green_led = 0;
+
+                sprintf(display_buffer, "Key saved...");
+                lcd.SetTextColor(LCD_COLOR_BLACK);                  // Set the color to the background color
+                lcd.FillRect(0, text_y, lcd.GetXSize(), FONT_SIZE); // Clear a specific line
+                lcd.SetTextColor(LCD_COLOR_BLUE);                   // Reset the text color
+                lcd.DisplayStringAt(text_x, text_y, (uint8_t *)display_buffer, CENTER_MODE);
             }
         }
         else if (flag_check & UNLOCK_FLAG)
@@ -357,7 +674,7 @@ void gyroscope_thread()
             temp_key.clear(); // clear temp_key
 
             // check if the gesture key is empty
-            if (gesture_key.empty())
+            if (gesture_keys.empty())
             {
                 sprintf(display_buffer, "NO KEY SAVED.");
                 lcd.SetTextColor(LCD_COLOR_BLACK);                  // Set the color to the background color
@@ -375,30 +692,159 @@ void gyroscope_thread()
             {
                 
                 int unlock = 0; // counter for the coordinates that are above threshold
+                int matched_key = -1; // index of the matching template
+
+#if UNLOCK_METRIC == METRIC_DTW
+                float distance;
+                if (online_valid)
+                {
+                    // the DTW rows were advanced while recording, mostly only the end cells are left to read
+                    size_t resolved;
+                    matched_key = online_match_dtw(online_matcher, unlocking_record, distance, resolved);
+                    printf("Online DTW distance: %f, key %d, %u keys in batch\n", distance, matched_key, (unsigned)resolved);
+                }
+                else
+                {
+                    matched_key = match_templates(gesture_keys, unlocking_record, DTW_THRESHOLD, distance, cascade_stats);
+                    printf("DTW distance: %f, key %d\n", distance, matched_key);
+                    printf("Cascade: %lu attempts, pruned by LB_Kim %lu, LB_Keogh %lu, DTW %lu, accepted %lu\n",
+                           (unsigned long)cascade_stats.attempts, (unsigned long)cascade_stats.pruned_kim,
+                           (unsigned long)cascade_stats.pruned_keogh, (unsigned long)cascade_stats.pruned_dtw,
+                           (unsigned long)cascade_stats.accepted);
+                }
+                if (matched_key >= 0)
+                {
+                    unlock = 3; // all coordinates match
+                }
+#elif UNLOCK_METRIC == METRIC_XCORR
+                // the key whose weakest axis has the highest cross-correlation peak, above the threshold
+                float best_score = CORRELATION_THRESHOLD;
+                to_axes(unlocking_axes, unlocking_record);
+                for (size_t k = 0; k < gesture_keys.size(); k++)
+                {
+                    err = 0;
+                    array<XcorrPeak, 3> peaks = xcorr_axes(gesture_keys[k].axes, unlocking_axes, XCORR_MAX_LAG);
+
+                    if (err != 0)
+                    {
+                        printf("Error calculating cross-correlation: recording too short or flat\n");
+                    }
+                    else
+                    {
+                        printf("Key %u cross-correlation peaks: x = %f at %d, y = %f at %d, z = %f at %d\n", (unsigned)k,
+                               peaks[0].score, peaks[0].lag, peaks[1].score, peaks[1].lag, peaks[2].score, peaks[2].lag);
+
+                        float score = min(peaks[0].score, min(peaks[1].score, peaks[2].score));
+                        if (score > best_score)
+                        {
+                            best_score = score;
+                            matched_key = k;
+                        }
+                    }
+                }
+                if (matched_key >= 0)
+                {
+                    unlock = 3; // all coordinates match
+                }
+#elif CORRELATION_RESAMPLE
+                if (unlocking_record.size() < 2)
+                {
+                    printf("Error calculating correlation: recording too short or flat\n");
+                }
+                else
+                {
+                    // both recordings at the same canonical length, a slower or faster gesture still lines up
+                    resample_canonical(unlocking_canonical, unlocking_record);
+                    canonical_stats(unlocking_stats, unlocking_canonical); // the key sums were cached when it was saved
+                    size_t candidates[TEMPLATE_CAPACITY];
+#if SAX_PREFILTER
+                    size_t candidate_count = sax_index_lookup(key_index, unlocking_canonical, CORRELATION_THRESHOLD, candidates);
+                    printf("SAX index: %u of %u keys are candidates\n", (unsigned)candidate_count, (unsigned)gesture_keys.size());
+#else
+                    size_t candidate_count = gesture_keys.size();
+                    for (size_t c = 0; c < candidate_count; c++)
+                    {
+                        candidates[c] = c;
+                    }
+#endif
+                    // the key whose weakest axis correlates best, above the threshold
+                    float best_score = CORRELATION_THRESHOLD;
+                    for (size_t c = 0; c < candidate_count; c++)
+                    {
+                        size_t k = candidates[c];
+                        err = 0;
+                        array<float, 3> correlationResult = correlation_canonical_q7(gesture_keys[k].canonical, gesture_keys[k].canonical_stats,
+                                                                                     unlocking_canonical, unlocking_stats); // calculate correlation
 
-                array<float, 3> correlationResult = calculateCorrelationVectors(gesture_key, unlocking_record); // calculate correlation
+                        if (err != 0)
+                        {
+                            printf("Error calculating correlation: recording too short or flat\n");
+                            continue;
+                        }
+                        printf("Key %u correlation values: x = %f, y = %f, z = %f\n", (unsigned)k, correlationResult[0], correlationResult[1], correlationResult[2]);
 
-                if (err != 0)
+                        float score = min(correlationResult[0], min(correlationResult[1], correlationResult[2]));
+                        if (score > best_score)
+                        {
+                            best_score = score;
+                            matched_key = k;
+                        }
+                    }
+                    if (matched_key >= 0)
+                    {
+                        unlock = 3; // all coordinates match
+                    }
+                }
+#else
+                if (online_valid)
                 {
-                    printf("Error calculating correlation: vectors have different sizes\n");
+                    // the correlation sums were accumulated while recording
+                    array<float, 3> correlationResult;
+                    matched_key = online_match_correlation(online_matcher, CORRELATION_THRESHOLD, correlationResult);
+                    printf("Online correlation values: x = %f, y = %f, z = %f, key %d\n",
+                           correlationResult[0], correlationResult[1], correlationResult[2], matched_key);
+                    if (matched_key >= 0)
+                    {
+                        unlock = 3; // all coordinates match
+                    }
                 }
                 else
                 {
-                    printf("Correlation values: x = %f, y = %f, z = %f\n", correlationResult[0], correlationResult[1], correlationResult[2]);
-                    
-                    // iterate through correlationResult to check if all values are above threshold
-                    for (size_t i = 0; i < correlationResult.size(); i++)
+                    // the key whose weakest axis correlates best, above the threshold
+                    float best_score = CORRELATION_THRESHOLD;
+                    to_axes(unlocking_axes, unlocking_record);
+                    for (size_t k = 0; k < gesture_keys.size(); k++)
                     {
-                        if (correlationResult[i] > CORRELATION_THRESHOLD)
+                        err = 0;
+                        array<float, 3> correlationResult = correlation_axes(gesture_keys[k].axes, unlocking_axes); // calculate correlation
+
+                        if (err != 0)
                         {
-                            unlock++;
+                            printf("Error calculating correlation: recording too short or flat\n");
+                        }
+                        else
+                        {
+                            printf("Key %u correlation values: x = %f, y = %f, z = %f\n", (unsigned)k, correlationResult[0], correlationResult[1], correlationResult[2]);
+
+                            float score = min(correlationResult[0], min(correlationResult[1], correlationResult[2]));
+                            if (score > best_score)
+                            {
+                                best_score = score;
+                                matched_key = k;
+                            }
                         }
                     }
+                    if (matched_key >= 0)
+                    {
+                        unlock = 3; // all coordinates match
+                    }
                 }
+#endif
+                printf("Decision %lu cycles after the recording ended\n", (unsigned long)(CycleCounterRead() - capture_end));
 
                 if (unlock==3) // TODO: need to find a better threshold
                 {
-                    sprintf(display_buffer, "UNLOCK: SUCCESS");
+                    sprintf(display_buffer, "UNLOCK: KEY %d", matched_key);
                     lcd.SetTextColor(LCD_COLOR_BLACK);                  // Set the color to the background color
                     lcd.FillRect(0, text_y, lcd.GetXSize(), FONT_SIZE); // Clear a specific line
                     lcd.SetTextColor(LCD_COLOR_BLUE);                   // Reset the text color
@@ -434,6 +880,195 @@ void gyroscope_thread()
     }
 }
 
+/*******************************************************************************
+ *
+ * @brief Start a FIFO burst on the watermark and re-arm the watermark flag
+ * @param gyro_flags: the event flags returned by the last wait
+ *
+ * ****************************************************************************/
+void service_gyro_fifo(uint32_t gyro_flags)
+{
+    if ((gyro_flags & DATA_READY_FLAG) && !IsGyroTransferBusy())
+    {
+        // Follow the temperature so the zero-rate level comes from the right calibration bucket,
+        // it changes over minutes, so a blocking register read every few bursts is plenty
+        if (temperature_bursts == 0)
+        {
+            SetGyroTemperature(ReadTemperature());
+            temperature_bursts = TEMPERATURE_BURSTS;
+        }
+        temperature_bursts--;
+        // Drain the FIFO in one asynchronous burst, the previous block is processed meanwhile
+        ReadFifoBurstAsync(GetFifoLevel(), onGyroBlockReady);
+    }
+    // The watermark is level triggered, re-arm the flag if it is still above the watermark
+    if ((gyro_flags & GYRO_BLOCK_FLAG) && gyro_int2.read() == 1)
+    {
+        flags.set(DATA_READY_FLAG);
+    }
+}
+
+/*******************************************************************************
+ *
+ * @brief Wait for gyroscope events for at most `timeout`
+ * A missed watermark edge or a stalled sensor must not block the thread for good, so
+ * on a timeout INT2 is polled; the watermark is level triggered, a high level means
+ * the FIFO is ready although no edge arrived
+ * @param wanted: the event flags to wait for
+ * @param timeout: the longest wait
+ * @return the flags that were set, DATA_READY_FLAG if INT2 is high after a timeout, 0 otherwise
+ *
+ * ****************************************************************************/
+uint32_t wait_gyro_flags(uint32_t wanted, chrono::milliseconds timeout)
+{
+    uint32_t result = flags.wait_any_for(wanted, max(timeout, chrono::milliseconds(0))); // the window may have just run out
+    if (result & osFlagsError)
+    {
+        return gyro_int2.read() == 1 ? DATA_READY_FLAG : 0;
+    }
+    return result;
+}
+
+/*******************************************************************************
+ *
+ * @brief Sleep until the running asynchronous burst is done, blocking reads and writes must not overlap it
+ * A burst that does not complete within GYRO_BUS_TIMEOUT is aborted and its samples are lost
+ *
+ * ****************************************************************************/
+void wait_for_gyro_bus()
+{
+    while (IsGyroTransferBusy())
+    {
+        // a flag left over from an earlier burst only costs one more round
+        if (flags.wait_any_for(GYRO_BUS_FLAG, GYRO_BUS_TIMEOUT) & osFlagsError)
+        {
+            AbortGyroTransfer();
+            printf("Gyroscope burst timed out, aborted\r\n");
+        }
+    }
+}
+
+/*******************************************************************************
+ *
+ * @brief Pop one batch from the sample ring and feed it to the zero-rate estimate
+ * @param raw: receives up to FIFO_DEPTH raw samples
+ * @param timestamps: receives the timestamp of each sample
+ * @return the number of samples popped
+ *
+ * ****************************************************************************/
+size_t pop_sample_batch(Gyroscope_RawData *raw, uint32_t *timestamps)
+{
+    Gyroscope_TimedSample batch[FIFO_DEPTH];
+    size_t count = sample_ring.Pop(batch, FIFO_DEPTH);
+    for (size_t i = 0; i < count; i++)
+    {
+        raw[i] = batch[i].data;
+        timestamps[i] = batch[i].timestamp;
+    }
+    UpdateBiasEstimate(raw, count); // still stretches of a recording count too
+    return count;
+}
+
+/*******************************************************************************
+ *
+ * @brief Drain the sample ring, calibrate, decimate and filter the samples
+ * @param decimator: the decimator from the ODR to the matching rate
+ * @param armed: true while waiting for the motion trigger, the samples go to the
+ *               pre-trigger buffer instead of temp_key
+ *
+ * ****************************************************************************/
+void drain_gesture_samples(CicDecimator<3> &decimator, bool armed)
+{
+    Gyroscope_RawData batch[FIFO_DEPTH];
+    uint32_t batch_time[FIFO_DEPTH];
+    Gyroscope_RawData decimated;
+    BurstInterval interval;
+    size_t count;
+
+    // Only the bursts of the recording count towards its jitter statistics
+    while (burst_ring.Pop(interval))
+    {
+        if (!armed)
+        {
+            UpdateJitterStats(&jitter_stats, interval);
+        }
+    }
+
+    // Drain the sample ring in batches
+    while ((count = pop_sample_batch(batch, batch_time)) > 0)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            CalibrateRawData(&batch[i]);
+            if (!decimator.Process(batch[i], decimated))
+            {
+                continue;
+            }
+            // the raw counts are converted to dps only for display
+            // a decimated sample is stamped with the time of its last input sample
+            TimedGestureSample sample = {gesture_filter.Process({decimated.x_raw, decimated.y_raw, decimated.z_raw}), batch_time[i]};
+            if (armed)
+            {
+                // keep only the latest samples
+                TimedGestureSample oldest;
+                if (pretrigger.Size() == pretrigger.Capacity())
+                {
+                    pretrigger.Pop(oldest);
+                }
+                pretrigger.Push(sample);
+            }
+            else
+            {
+                append_gesture_sample(sample.sample, sample.timestamp);
+            }
+        }
+    }
+}
+
+/*******************************************************************************
+ *
+ * @brief Append a sample to temp_key and feed it to the endpoint detector and the online matcher
+ * @param sample: the decimated sample
+ * @param timestamp: its DWT cycle count
+ *
+ * ****************************************************************************/
+void append_gesture_sample(const GestureSample &sample, uint32_t timestamp)
+{
+    if (temp_key.full())
+    {
+        return;
+    }
+    // Add the raw counts to the gesture_key vector
+    temp_key.push_back(sample);
+    temp_key_time.push_back(timestamp);
+    endpoint.Process(sample);
+    if (online_matching)
+    {
+        online_match_push(online_matcher, sample);
+    }
+}
+
+/*******************************************************************************
+ *
+ * @brief Switch the gyroscope to another output data rate and FIFO watermark
+ * The FIFO is flushed, the sample clock is anchored again and the decimator follows the new rate
+ * @param parameters: the configuration with the new ODR in conf1
+ * @param watermark: the FIFO watermark
+ * @param decimator: the decimator from the ODR to the matching rate
+ *
+ * ****************************************************************************/
+void switch_gyro_rate(const Gyroscope_Init_Parameters *parameters, uint8_t watermark, CicDecimator<3> &decimator)
+{
+    wait_for_gyro_bus();
+    SetOutputDataRate(parameters->conf1);
+    EnableFifoStream(watermark);
+    odr_period = PeriodInCycles(GetOutputDataRate(parameters));
+    clock_anchored = false;
+    decimator.Reset(GetDecimationFactor(parameters));
+    sample_ring.Clear();
+    burst_ring.Clear();
+}
+
 /*******************************************************************************
  *
  * @brief touch screen thread
@@ -497,13 +1132,13 @@ void touch_screen_thread()
  * @return true if the data is stored successfully, false otherwise
  *
  * ****************************************************************************/
-bool storeGyroDataToFlash(vector<array<float, 3>> &gesture_key, uint32_t flash_address)
+bool storeGyroDataToFlash(GestureRecord &gesture_key, uint32_t flash_address)
 {
     FlashIAP flash;
     flash.init();
 
     // Calculate the total size of the data to be stored in bytes
-    uint32_t data_size = gesture_key.size() * sizeof(array<float, 3>);
+    uint32_t data_size = gesture_key.size() * sizeof(GestureSample);
 
     // Erase the flash sector
     flash.erase(flash_address, data_size);
@@ -519,24 +1154,22 @@ bool storeGyroDataToFlash(vector<array<float, 3>> &gesture_key, uint32_t flash_a
 /*******************************************************************************
  *
  * @brief read data from flash
+ * @param gesture_key: the record to fill
  * @param flash_address: the address of the flash to read
- * @param data_size: the size of the data to read in bytes
- * @return a vector of array<float, 3> containing the data
+ * @param data_size: the number of samples to read, clamped to the record capacity
  *
  * ****************************************************************************/
-vector<array<float, 3>> readGyroDataFromFlash(uint32_t flash_address, size_t data_size)
+void readGyroDataFromFlash(GestureRecord &gesture_key, uint32_t flash_address, size_t data_size)
 {
-    vector<array<float, 3>> gesture_key(data_size);
+    gesture_key.resize(data_size);
 
     FlashIAP flash;
     flash.init();
 
     // Read the data from flash
-    flash.read(gesture_key.data(), flash_address, data_size * sizeof(array<float, 3>));
+    flash.read(gesture_key.data(), flash_address, gesture_key.size() * sizeof(GestureSample));
 
     flash.deinit();
-
-    return gesture_key;
 }
 
 /*******************************************************************************
@@ -572,165 +1205,3 @@ bool is_touch_inside_button(int touch_x, int touch_y, int button_x, int button_y
     return (touch_x >= button_x && touch_x <= button_x + button_width &&
             touch_y >= button_y && touch_y <= button_y + button_height);
 }
-
-/*******************************************************************************
- *
- * @brief Calculate the euclidean distance between two vectors
- * @param a: the first vector
- * @param b: the second vector
- * @return the euclidean distance between the two vectors
- *
- * ****************************************************************************/
-float euclidean_distance(const array<float, 3> &a, const array<float, 3> &b)
-{
-    float sum = 0;
-    for (size_t i = 0; i < 3; ++i)
-    {
-        sum += (a[i] - b[i]) * (a[i] - b[i]);
-    }
-    return sqrt(sum);
-}
-
-/*******************************************************************************
- *
- * @brief Calculate the DTW distance between two vectors
- * @param s: the first vectorS
- * @param t: the second vector
- * @return the DTW distance between the two vectors
- *
- * ****************************************************************************/
-float dtw(const vector<array<float, 3>> &s, const vector<array<float, 3>> &t)
-{
-    vector<vector<float>> dtw_matrix(s.size() + 1, vector<float>(t.size() + 1, numeric_limits<float>::infinity()));
-
-    dtw_matrix[0][0] = 0;
-
-    for (size_t i = 1; i <= s.size(); ++i)
-    {
-        for (size_t j = 1; j <= t.size(); ++j)
-        {
-            float cost = euclidean_distance(s[i - 1], t[j - 1]);
-            dtw_matrix[i][j] = cost + min({dtw_matrix[i - 1][j], dtw_matrix[i][j - 1], dtw_matrix[i - 1][j - 1]});
-        }
-    }
-
-    return dtw_matrix[s.size()][t.size()];
-}
-
-/*******************************************************************************
- *
- * @brief Trim the gyro data
- * @param data: the gyro data to trim
- *
- * ****************************************************************************/
-void trim_gyro_data(vector<array<float, 3>> &data)
-{
-    float threshold = 0.00001;
-    auto ptr = data.begin();
-    // find the first element where data from any
-    // one direction is larger than the threshold
-    while (abs((*ptr)[0]) <= threshold && abs((*ptr)[1]) <= threshold && abs((*ptr)[2]) <= threshold)
-    {
-        ptr++;
-    }
-    if (ptr == data.end())
-        return;      // all data less than threshold
-    auto lptr = ptr; // record the left bound
-    // start searching from end to front
-    ptr = data.end() - 1;
-    while (abs((*ptr)[0]) <= threshold && abs((*ptr)[1]) <= threshold && abs((*ptr)[2]) <= threshold)
-    {
-        ptr--;
-    }
-    auto rptr = ptr; // record the right bound
-    // start moving elements to the front
-    auto replace_ptr = data.begin();
-    for (; replace_ptr != lptr && lptr <= rptr; replace_ptr++, lptr++)
-    {
-        *replace_ptr = *lptr;
-    }
-    // trim the end
-    if (lptr > rptr)
-    {
-        data.erase(replace_ptr, data.end());
-    }
-    else
-    {
-        data.erase(rptr + 1, data.end());
-    }
-}
-
-/*******************************************************************************
- *
- * @brief Calculate the correlation between two vectors
- * @param a: the first vector
- * @param b: the second vector
- * @return the correlation between the two vectors
- *
- * ****************************************************************************/
-float correlation(const vector<float> &a, const vector<float> &b)
-{
-    // check if the size of the two vectors are the same
-    if (a.size() != b.size())
-    {
-        err = -1;
-        return 0.0f;
-    }
-
-    float sum_a = 0, sum_b = 0, sum_ab = 0, sq_sum_a = 0, sq_sum_b = 0;
-
-    for (size_t i = 0; i < a.size(); ++i)
-    {
-        sum_a += a[i];
-        sum_b += b[i];
-        sum_ab += a[i] * b[i];
-        sq_sum_a += a[i] * a[i];
-        sq_sum_b += b[i] * b[i];
-    }
-
-    size_t n = a.size(); // number of elements
-
-    float numerator = n * sum_ab - sum_a * sum_b; // Covariance
-    
-    float denominator = sqrt((n * sq_sum_a - sum_a * sum_a) * (n * sq_sum_b - sum_b * sum_b)); // Standard deviation
-
-    return numerator / denominator;
-}
-
-/*******************************************************************************
- *
- * @brief Calculate the correlation between two vectors
- * @param a: the first vector
- * @param b: the second vector
- * @return the correlation between the two vectors
- *
- * ****************************************************************************/
-array<float, 3> calculateCorrelationVectors(vector<array<float, 3>>& vec1, vector<array<float, 3>>& vec2) {
-    array<float, 3> result;
-
-    // Calculate the correlation for each coordinate
-    for (int i = 0; i < 3; i++) {
-        vector<float> a;
-        vector<float> b;
-
-        // Populate 'a' and 'b' with the ith coordinates of vec1 and vec2
-        for (const auto& arr : vec1) {
-            a.push_back(arr[i]);
-        }
-        for (const auto& arr : vec2) {
-            b.push_back(arr[i]);
-        }
-
-        // Resize 'a' to match the size of 'b', if necessary
-        if (a.size() > b.size()) {
-            a.resize(b.size(), 0);
-        } else if (b.size() > a.size()) {
-            b.resize(a.size(), 0);
-        }
-
-        // Calculate the correlation and store the result
-        result[i] = correlation(a, b);
-    }
-
-    return result;
-}
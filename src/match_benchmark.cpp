@@ -0,0 +1,1032 @@
+#include <stdio.h>
+#include <cmath>
+#include <algorithm>
+#include "gesture.h"
+#include "cycle_counter.h"
+#include "dsp_kernels.h"
+#include "benchmark.h"
+#include "template_average.h"
+#include "sax_index.h"
+#include "filter_stages.h"
+#include "online_match.h"
+#include "ring_buffer.h"
+#ifdef HOST_BUILD
+#include <thread>
+#endif
+
+// Matcher benchmarks, they only depend on the gesture code so they also build on the host:
+//   g++ -std=gnu++14 -O2 -pthread -D HOST_BUILD src/gesture.cpp src/fft.cpp src/template_average.cpp src/sax_index.cpp src/online_match.cpp src/match_benchmark.cpp -o match_benchmark
+// On the host the figures are nanoseconds instead of cycles
+
+#define BENCH_DTW_THRESHOLD 1500.0f
+
+TemplateStore bench_store;      // synthetic enrolled templates
+GestureRecord bench_record;     // scratch record to enroll from
+GestureRecord bench_query;      // synthetic unlocking attempt
+MatchCascadeStats bench_stats;  // pruning counters of the template search
+
+/*******************************************************************************
+ *
+ * @brief Fill a record with a synthetic gesture in raw counts
+ * @param record: the record to fill
+ * @param seed: seed of the noise generator
+ * @param phase: phase offset of the motion in radians
+ *
+ * ****************************************************************************/
+void FillSyntheticGesture(GestureRecord &record, uint32_t seed, float phase)
+{
+    record.clear();
+    while (!record.full())
+    {
+        float t = record.size() * (2.0f * 3.14159265f / RECORD_CAPACITY);
+        GestureSample sample;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            seed = seed * 1664525u + 1013904223u; // LCG noise
+            int noise = (int)(seed >> 23) - 256;
+            sample[axis] = (int16_t)(8000.0f * sinf((axis + 1) * t + phase) + noise);
+        }
+        record.push_back(sample);
+    }
+}
+
+#define BOUND_BENCH_PAIRS 200 // key and attempt pairs of random lengths for the lower bound check
+
+GestureRecord bench_spread; // per-sample tolerance of the keys of the lower bound check
+
+/*******************************************************************************
+ *
+ * @brief Time a full scan and the pruned best-match search for 1..TEMPLATE_CAPACITY templates
+ * The first attempt matches the last enrolled template, i.e. the one a linear scan reaches
+ * last, the second one is barely moving and matches none of them. Then LB_Kim and
+ * LB_Keogh are checked against the DTW they bound for keys and attempts of random
+ * lengths, shifts and spreads, including keys much longer than the attempt
+ * @return the number of pairs where a bound exceeds the DTW distance
+ *
+ * ****************************************************************************/
+int BenchmarkTemplateSearch()
+{
+    bench_store.clear();
+    for (size_t count = 1; count <= TEMPLATE_CAPACITY; count++)
+    {
+        FillSyntheticGesture(bench_record, count, 1.5f * (count - 1)); // templates with distinct phases
+        add_template(bench_store, bench_record, RECORD_CAPACITY / 10);
+
+        for (int attempt = 0; attempt < 2; attempt++)
+        {
+            FillSyntheticGesture(bench_query, 100 + attempt, 1.5f * (count - 1) + 0.1f);
+            if (attempt == 1)
+            {
+                for (size_t i = 0; i < bench_query.size(); i++)
+                {
+                    for (int axis = 0; axis < 3; axis++)
+                    {
+                        bench_query[i][axis] /= 16; // barely moving, matches no template
+                    }
+                }
+            }
+
+            // every template with the plain banded DTW, no bounds and no abandoning
+            uint32_t start = CycleCounterRead();
+            for (size_t k = 0; k < bench_store.size(); k++)
+            {
+                dtw(bench_store[k].samples, bench_query, bench_store[k].band, numeric_limits<float>::infinity());
+            }
+            uint32_t scan_cycles = CycleCounterRead() - start;
+
+            bench_stats = MatchCascadeStats();
+            float distance;
+            start = CycleCounterRead();
+            int match = match_templates(bench_store, bench_query, BENCH_DTW_THRESHOLD, distance, bench_stats);
+            uint32_t search_cycles = CycleCounterRead() - start;
+
+            printf("[bench] %u templates, %s attempt: scan %lu, search %lu (key %d, pruned kim %lu keogh %lu dtw %lu)\r\n",
+                   (unsigned)count, attempt == 0 ? "matching" : "foreign", (unsigned long)scan_cycles,
+                   (unsigned long)search_cycles, match, (unsigned long)bench_stats.pruned_kim,
+                   (unsigned long)bench_stats.pruned_keogh, (unsigned long)bench_stats.pruned_dtw);
+        }
+    }
+    bench_store.clear();
+
+    int violations = 0;
+    uint32_t seed = 4242;
+    for (int pair = 0; pair < BOUND_BENCH_PAIRS; pair++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        size_t key_length = 8 + (seed >> 8) % (RECORD_CAPACITY - 7);
+        seed = seed * 1664525u + 1013904223u;
+        size_t query_length = 8 + (seed >> 8) % (RECORD_CAPACITY - 7);
+        seed = seed * 1664525u + 1013904223u;
+        int shift = (int)((seed >> 8) % 101) - 50;
+
+        // the same ramp, the attempt shifted in time and performed at another length
+        bench_record.resize(key_length);
+        bench_spread.resize(key_length);
+        for (size_t i = 0; i < key_length; i++)
+        {
+            for (int axis = 0; axis < 3; axis++)
+            {
+                seed = seed * 1664525u + 1013904223u;
+                bench_record[i][axis] = (int16_t)((int)(i * 200 / key_length) * (axis + 1) * 40 - 8000 + (int)(seed >> 24));
+                bench_spread[i][axis] = (int16_t)(pair & 1 ? (seed >> 16) % 300 : 0);
+            }
+        }
+        bench_query.resize(query_length);
+        for (size_t i = 0; i < query_length; i++)
+        {
+            for (int axis = 0; axis < 3; axis++)
+            {
+                seed = seed * 1664525u + 1013904223u;
+                int position = min(max((int)(i * 200 / query_length) + shift, 0), 199);
+                bench_query[i][axis] = (int16_t)(position * (axis + 1) * 40 - 8000 + (int)(seed >> 24));
+            }
+        }
+
+        bench_store.clear();
+        add_template(bench_store, bench_record, RECORD_CAPACITY / 10, pair & 1 ? &bench_spread : nullptr);
+        const GestureKey &key = bench_store[0];
+        float distance = dtw(key.samples, bench_query, key.band, numeric_limits<float>::infinity(), key_spread(key));
+        float kim = lb_kim(key.samples, bench_query, key_spread(key));
+        float keogh = lb_keogh(key, bench_query);
+        float slack = distance * 1e-5f + 1e-3f; // float summation order
+        if (kim > distance + slack || keogh > distance + slack)
+        {
+            violations++;
+            printf("[bench] lower bound violated: key %u, attempt %u, shift %d, LB_Kim %.1f, LB_Keogh %.1f, DTW %.1f\r\n",
+                   (unsigned)key_length, (unsigned)query_length, shift, kim, keogh, distance);
+        }
+    }
+    printf("[bench] lower bounds: %d of %d pairs above the DTW distance\r\n", violations, BOUND_BENCH_PAIRS);
+    bench_store.clear();
+    return violations;
+}
+
+#define XCORR_BENCH_PAIRS 100
+#define XCORR_BENCH_LAG (MATCH_RATE_HZ / 2) // the lag window of the unlocking path
+#define XCORR_BENCH_THRESHOLD 0.3f
+
+GestureAxes bench_axes[2]; // key and attempt per axis
+
+/*******************************************************************************
+ *
+ * @brief Pearson correlation of a[i] and b[i + lag] over their overlap, in double
+ * @return the correlation, 0 if one side is flat
+ *
+ * ****************************************************************************/
+double PearsonAtLag(const int16_t *a, int na, const int16_t *b, int nb, int lag)
+{
+    double sa = 0, sb = 0, saa = 0, sbb = 0, sab = 0;
+    int m = 0;
+    for (int i = max(0, -lag); i < min(na, nb - lag); i++, m++)
+    {
+        double va = a[i], vb = b[i + lag];
+        sa += va;
+        sb += vb;
+        saa += va * va;
+        sbb += vb * vb;
+        sab += va * vb;
+    }
+    double denominator = sqrt((m * saa - sa * sa) * (m * sbb - sb * sb));
+    return denominator > 0 ? (m * sab - sa * sb) / denominator : 0.0;
+}
+
+/*******************************************************************************
+ *
+ * @brief Check the FFT cross-correlation against a brute-force Pearson over every lag
+ * Keys and attempts of random lengths and shifts are compared lag by lag with the
+ * overlap rule of xcorr_axes; then attempts a few samples long, which correlate by
+ * chance, must be rejected by both xcorr_axes and correlation_axes
+ * @return the peaks that differ from the brute force, plus the short attempts that pass
+ *
+ * ****************************************************************************/
+int BenchmarkCrossCorrelation()
+{
+    int mismatches = 0;
+    float worst = 0.0f;
+    uint32_t xcorr_cycles = 0;
+    uint32_t seed = 9001;
+    for (int pair = 0; pair < XCORR_BENCH_PAIRS; pair++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        size_t key_length = 16 + (seed >> 8) % (RECORD_CAPACITY - 15);
+        seed = seed * 1664525u + 1013904223u;
+        size_t query_length = 16 + (seed >> 8) % (RECORD_CAPACITY - 15);
+        FillSyntheticGesture(bench_record, pair + 1, 0.0f);
+        FillSyntheticGesture(bench_query, pair + 1000, 0.02f * (pair % 50));
+        bench_record.resize(key_length);
+        bench_query.resize(query_length);
+        to_axes(bench_axes[0], bench_record);
+        to_axes(bench_axes[1], bench_query);
+
+        err = 0;
+        uint32_t start = CycleCounterRead();
+        array<XcorrPeak, 3> peaks = xcorr_axes(bench_axes[0], bench_axes[1], XCORR_BENCH_LAG);
+        xcorr_cycles += CycleCounterRead() - start;
+
+        int na = key_length, nb = query_length;
+        int overlap_limit = min_overlap(key_length, query_length);
+        for (int axis = 0; axis < 3; axis++)
+        {
+            bool found = false;
+            double best = 0.0;
+            for (int lag = -XCORR_BENCH_LAG; lag <= XCORR_BENCH_LAG; lag++)
+            {
+                if (min(na, nb - lag) - max(0, -lag) < overlap_limit)
+                {
+                    continue;
+                }
+                double r = PearsonAtLag(bench_axes[0].axis[axis], na, bench_axes[1].axis[axis], nb, lag);
+                if (!found || r > best)
+                {
+                    best = r;
+                    found = true;
+                }
+            }
+            // no lag with enough overlap has to come back as an error
+            if (found != (err == 0))
+            {
+                mismatches++;
+                continue;
+            }
+            if (!found)
+            {
+                continue;
+            }
+            float difference = fabsf(peaks[axis].score - (float)best);
+            float at_lag = fabsf(peaks[axis].score - (float)PearsonAtLag(bench_axes[0].axis[axis], na, bench_axes[1].axis[axis], nb, peaks[axis].lag));
+            worst = max(worst, max(difference, at_lag));
+            mismatches += !(difference <= 1e-3f && at_lag <= 1e-3f && fabsf(peaks[axis].score) <= 1.0f);
+        }
+    }
+
+    // random attempts of a few samples against a full-length key
+    int accepted = 0;
+    FillSyntheticGesture(bench_record, 7, 0.0f);
+    bench_record.resize(150);
+    to_axes(bench_axes[0], bench_record);
+    for (int attempt = 0; attempt < XCORR_BENCH_PAIRS; attempt++)
+    {
+        bench_query.resize(2 + attempt % 11);
+        for (size_t i = 0; i < bench_query.size(); i++)
+        {
+            for (int axis = 0; axis < 3; axis++)
+            {
+                seed = seed * 1664525u + 1013904223u;
+                bench_query[i][axis] = (int16_t)(seed >> 16);
+            }
+        }
+        to_axes(bench_axes[1], bench_query);
+
+        err = 0;
+        array<XcorrPeak, 3> peaks = xcorr_axes(bench_axes[0], bench_axes[1], XCORR_BENCH_LAG);
+        accepted += err == 0 && peaks[0].score > XCORR_BENCH_THRESHOLD && peaks[1].score > XCORR_BENCH_THRESHOLD &&
+                    peaks[2].score > XCORR_BENCH_THRESHOLD;
+        err = 0;
+        array<float, 3> r = correlation_axes(bench_axes[0], bench_axes[1]);
+        accepted += err == 0 && r[0] > XCORR_BENCH_THRESHOLD && r[1] > XCORR_BENCH_THRESHOLD && r[2] > XCORR_BENCH_THRESHOLD;
+    }
+    err = 0;
+
+    printf("[bench] cross-correlation: %d of %d peaks off the brute force (largest difference %.5f), %lu per pair\r\n",
+           mismatches, 3 * XCORR_BENCH_PAIRS, worst, (unsigned long)(xcorr_cycles / XCORR_BENCH_PAIRS));
+    printf("[bench] short attempts: %d of %d accepted\r\n", accepted, 2 * XCORR_BENCH_PAIRS);
+    return mismatches + accepted;
+}
+
+#define ENROLL_BENCH_REPETITIONS 3 // repetitions averaged into the key
+#define ENROLL_BENCH_ATTEMPTS 64   // genuine and impostor attempts each
+#define ENROLL_BENCH_MAX_REJECTS 4 // genuine attempts the averaged key may reject at 0 false accepts
+
+TemplateAverage bench_average; // running average of the enrollment repetitions
+
+/*******************************************************************************
+ *
+ * @brief Fill a record with one performance of a synthetic gesture
+ * Every performance is a little faster or slower, warped in time, scaled and noisy;
+ * the impostor performs the same motion with a different second half on one axis
+ * @param record: the record to fill
+ * @param seed: seed of this performance
+ * @param impostor: perform the impostor's variant
+ *
+ * ****************************************************************************/
+void FillSyntheticRepetition(GestureRecord &record, uint32_t seed, bool impostor)
+{
+    seed = seed * 1664525u + 1013904223u;
+    size_t length = RECORD_CAPACITY * 3 / 4 + (seed >> 8) % (RECORD_CAPACITY / 4); // 75..100 % of the window
+    seed = seed * 1664525u + 1013904223u;
+    float warp = ((int)(seed >> 16) - 32768) / 32768.0f * 0.35f; // time warp in radians
+    seed = seed * 1664525u + 1013904223u;
+    float gain = 1.0f + ((int)(seed >> 16) - 32768) / 32768.0f * 0.15f;
+
+    record.clear();
+    for (size_t i = 0; i < length; i++)
+    {
+        float u = (float)i / (length - 1);
+        float t = 2.0f * 3.14159265f * u + warp * sinf(3.14159265f * u);
+        GestureSample sample;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float motion = sinf((axis + 1) * t);
+            if (impostor && axis == 2 && u > 0.5f)
+            {
+                motion = sinf((axis + 1) * t + 0.5f); // the impostor differs in the second half
+            }
+            seed = seed * 1664525u + 1013904223u;
+            int noise = (int)(seed >> 21) - 1024;
+            sample[axis] = (int16_t)(8000.0f * gain * motion + noise);
+        }
+        record.push_back(sample);
+    }
+}
+
+/*******************************************************************************
+ *
+ * @brief False rejects of a single-recording key and of an averaged key at the same false-accept rate
+ * Both keys are enrolled from the same repetitions; each gets the largest threshold that
+ * still rejects every impostor attempt, then the genuine attempts below it are counted
+ * @return the averaged key's rejects above ENROLL_BENCH_MAX_REJECTS, plus 1 if it rejects more than the single key
+ *
+ * ****************************************************************************/
+int BenchmarkEnrollment()
+{
+    const float inf = numeric_limits<float>::infinity();
+    float genuine[2][ENROLL_BENCH_ATTEMPTS];
+    float impostor[2][ENROLL_BENCH_ATTEMPTS];
+
+    bench_store.clear();
+    template_average_reset(bench_average);
+    for (uint32_t r = 0; r < ENROLL_BENCH_REPETITIONS; r++)
+    {
+        FillSyntheticRepetition(bench_record, 1 + r, false);
+        if (r == 0)
+        {
+            add_template(bench_store, bench_record, RECORD_CAPACITY / 10);
+        }
+        uint32_t start = CycleCounterRead();
+        float distance = template_average_add(bench_average, bench_record, RECORD_CAPACITY / 10, inf);
+        printf("[bench] repetition %lu: distance to the average %.1f, %lu to fold in\r\n", (unsigned long)r + 1,
+               distance, (unsigned long)(CycleCounterRead() - start));
+    }
+    add_template_average(bench_store, bench_average, RECORD_CAPACITY / 10);
+
+    for (uint32_t a = 0; a < ENROLL_BENCH_ATTEMPTS; a++)
+    {
+        for (int impostor_attempt = 0; impostor_attempt < 2; impostor_attempt++)
+        {
+            FillSyntheticRepetition(bench_query, 1000 + 2 * a + impostor_attempt, impostor_attempt);
+            for (int k = 0; k < 2; k++)
+            {
+                const GestureKey &key = bench_store[k];
+                float d = dtw(key.samples, bench_query, key.band, inf, key_spread(key));
+                (impostor_attempt ? impostor : genuine)[k][a] = d;
+            }
+        }
+    }
+
+    int rejects[2];
+    for (int k = 0; k < 2; k++)
+    {
+        float threshold = inf;
+        for (int a = 0; a < ENROLL_BENCH_ATTEMPTS; a++)
+        {
+            threshold = min(threshold, impostor[k][a]);
+        }
+        rejects[k] = 0;
+        for (int a = 0; a < ENROLL_BENCH_ATTEMPTS; a++)
+        {
+            rejects[k] += genuine[k][a] >= threshold;
+        }
+        printf("[bench] %s key: %d of %d genuine attempts rejected at 0 of %d impostors accepted (threshold %.1f)\r\n",
+               k == 0 ? "single" : "averaged", rejects[k], ENROLL_BENCH_ATTEMPTS, ENROLL_BENCH_ATTEMPTS, threshold);
+    }
+    bench_store.clear();
+    return max(rejects[1] - ENROLL_BENCH_MAX_REJECTS, 0) + (rejects[1] > rejects[0]);
+}
+
+#define ONLINE_BENCH_ATTEMPTS 300
+#define ONLINE_BENCH_LENGTH 200   // length of the first key, the others are 2 samples longer each
+#define ONLINE_BENCH_THRESHOLD 800.0f // between the genuine and the impostor distances of the synthetic repetitions
+
+OnlineMatcher bench_online; // the streaming matcher under test
+
+/*******************************************************************************
+ *
+ * @brief Stretch a record to another length, nearest neighbour
+ * @param out: the stretched record
+ * @param in: the record, at least 2 samples
+ * @param length: the new length, at least 2
+ *
+ * ****************************************************************************/
+void StretchRecord(GestureRecord &out, const GestureRecord &in, size_t length)
+{
+    out.resize(length);
+    for (size_t i = 0; i < length; i++)
+    {
+        out[i] = in[(i * (in.size() - 1) + (length - 1) / 2) / (length - 1)];
+    }
+}
+
+/*******************************************************************************
+ *
+ * @brief Compare the online DTW decision with the batch match_templates() on the same attempts
+ * Two keys of the gesture and two of the impostor's variant are enrolled at similar
+ * lengths; half of the attempts are stretched to within a few samples of them, where
+ * the online bounds usually decide, the others keep their own length and mostly
+ * need the batch DTW
+ * @return the number of attempts where the online and the batch matcher pick different keys
+ *
+ * ****************************************************************************/
+int BenchmarkOnlineMatch()
+{
+    bench_store.clear();
+    for (uint32_t k = 0; k < TEMPLATE_CAPACITY; k++)
+    {
+        FillSyntheticRepetition(bench_query, 3000 + k, k >= TEMPLATE_CAPACITY / 2);
+        StretchRecord(bench_record, bench_query, ONLINE_BENCH_LENGTH + 2 * k);
+        add_template(bench_store, bench_record, RECORD_CAPACITY / 10);
+    }
+
+    int mismatches = 0, accepted = 0;
+    size_t online_only = 0;
+    uint32_t online_cycles = 0, batch_cycles = 0;
+    uint32_t seed = 31337;
+    for (uint32_t a = 0; a < ONLINE_BENCH_ATTEMPTS; a++)
+    {
+        FillSyntheticRepetition(bench_record, 5000 + a, a % 3 == 0);
+        if (a & 1)
+        {
+            // to the key lengths give or take a few samples
+            seed = seed * 1664525u + 1013904223u;
+            StretchRecord(bench_query, bench_record, ONLINE_BENCH_LENGTH + (seed >> 8) % 25 - 9);
+        }
+        else
+        {
+            bench_query = bench_record;
+        }
+        trim_gyro_data(bench_query);
+
+        online_match_reset(bench_online, bench_store, ONLINE_BENCH_THRESHOLD);
+        for (size_t i = 0; i < bench_query.size(); i++)
+        {
+            online_match_push(bench_online, bench_query[i]);
+        }
+        float online_distance, batch_distance;
+        size_t resolved;
+        uint32_t start = CycleCounterRead();
+        int online = online_match_dtw(bench_online, bench_query, online_distance, resolved);
+        online_cycles += CycleCounterRead() - start;
+
+        bench_stats = MatchCascadeStats();
+        start = CycleCounterRead();
+        int batch = match_templates(bench_store, bench_query, ONLINE_BENCH_THRESHOLD, batch_distance, bench_stats);
+        batch_cycles += CycleCounterRead() - start;
+
+        online_only += resolved == 0;
+        accepted += batch >= 0;
+        if (online != batch)
+        {
+            mismatches++;
+            printf("[bench] online key %d (%.1f), batch key %d (%.1f), attempt %u samples\r\n", online, online_distance,
+                   batch, batch_distance, (unsigned)bench_query.size());
+        }
+    }
+    printf("[bench] online DTW: %d of %d attempts differ from the batch matcher, %u decided without a batch DTW, %d accepted\r\n",
+           mismatches, ONLINE_BENCH_ATTEMPTS, (unsigned)online_only, accepted);
+    printf("[bench] online DTW: decision after the last sample %lu, batch match %lu\r\n", (unsigned long)online_cycles,
+           (unsigned long)batch_cycles);
+    bench_store.clear();
+    return mismatches;
+}
+
+#define QUANT_BENCH_TOLERANCE 0.01f // largest correlation difference of the int8 key
+
+CanonicalAxes bench_canonical[2]; // key and attempt at the canonical length
+QuantizedCanonical bench_quantized; // the key in int8
+
+/*******************************************************************************
+ *
+ * @brief Accuracy and speed of the int8 keys against the int16 ones
+ * Correlates genuine and impostor performances against a key in both formats and
+ * compares the results
+ * @return the number of correlations that differ by more than QUANT_BENCH_TOLERANCE
+ *
+ * ****************************************************************************/
+int BenchmarkQuantizedTemplates()
+{
+    int failures = 0;
+    float worst = 0.0f;
+    uint32_t q15_cycles = 0, q7_cycles = 0;
+
+    FillSyntheticRepetition(bench_record, 1, false);
+    resample_canonical(bench_canonical[0], bench_record);
+    quantize_canonical(bench_quantized, bench_canonical[0]);
+
+    for (uint32_t a = 0; a < ENROLL_BENCH_ATTEMPTS; a++)
+    {
+        FillSyntheticRepetition(bench_query, 2000 + a, a & 1);
+        resample_canonical(bench_canonical[1], bench_query);
+
+        uint32_t start = CycleCounterRead();
+        array<float, 3> reference = correlation_canonical(bench_canonical[0], bench_canonical[1]);
+        q15_cycles += CycleCounterRead() - start;
+        start = CycleCounterRead();
+        array<float, 3> quantized = correlation_canonical_q7(bench_quantized, bench_canonical[1]);
+        q7_cycles += CycleCounterRead() - start;
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float difference = fabsf(quantized[axis] - reference[axis]);
+            worst = max(worst, difference);
+            failures += !(difference <= QUANT_BENCH_TOLERANCE);
+        }
+    }
+
+    printf("[bench] int8 key: %u of %u bytes per axis, correlation int16 %lu, int8 %lu, largest difference %.5f\r\n",
+           (unsigned)sizeof(bench_quantized.axis[0]), (unsigned)sizeof(bench_canonical[0].axis[0]),
+           (unsigned long)q15_cycles, (unsigned long)q7_cycles, worst);
+    return failures;
+}
+
+#define SAX_BENCH_ATTEMPTS 64
+
+SaxIndex bench_index; // coarse index of bench_store
+
+/*******************************************************************************
+ *
+ * @brief Candidates the SAX index passes on to the exact correlation, and what it costs
+ * Every enrolled template is a different synthetic gesture; attempts of each are
+ * looked up at a loose and a strict threshold and checked against the exact
+ * correlation of every template
+ * @return the number of templates the index dropped although they pass the exact correlation
+ *
+ * ****************************************************************************/
+int BenchmarkSaxIndex()
+{
+    const float thresholds[2] = {0.3f, 0.8f};
+    size_t candidates[TEMPLATE_CAPACITY];
+    int dismissals = 0;
+
+    bench_store.clear();
+    for (size_t count = 0; count < TEMPLATE_CAPACITY; count++)
+    {
+        FillSyntheticGesture(bench_record, count + 1, 1.5f * count);
+        add_template(bench_store, bench_record, RECORD_CAPACITY / 10);
+    }
+    uint32_t start = CycleCounterRead();
+    sax_index_build(bench_index, bench_store);
+    uint32_t build_cycles = CycleCounterRead() - start;
+
+    for (int t = 0; t < 2; t++)
+    {
+        uint32_t lookup_cycles = 0, exact_cycles = 0;
+        size_t total = 0, passing = 0;
+        for (uint32_t a = 0; a < SAX_BENCH_ATTEMPTS; a++)
+        {
+            FillSyntheticGesture(bench_query, 300 + a, 1.5f * (a % TEMPLATE_CAPACITY) + 0.05f * (a % 7));
+            resample_canonical(bench_canonical[1], bench_query);
+
+            start = CycleCounterRead();
+            size_t count = sax_index_lookup(bench_index, bench_canonical[1], thresholds[t], candidates);
+            lookup_cycles += CycleCounterRead() - start;
+            total += count;
+
+            start = CycleCounterRead();
+            for (size_t k = 0; k < bench_store.size(); k++)
+            {
+                array<float, 3> r = correlation_canonical_q7(bench_store[k].canonical, bench_canonical[1]);
+                if (r[0] > thresholds[t] && r[1] > thresholds[t] && r[2] > thresholds[t])
+                {
+                    passing++;
+                    bool listed = false;
+                    for (size_t c = 0; c < count; c++)
+                    {
+                        listed = listed || candidates[c] == k;
+                    }
+                    dismissals += !listed;
+                }
+            }
+            exact_cycles += CycleCounterRead() - start;
+        }
+        printf("[bench] sax index at %.1f: %u candidates of %u templates per attempt (%u pass), lookup %lu, full scan %lu\r\n",
+               thresholds[t], (unsigned)(total / SAX_BENCH_ATTEMPTS), (unsigned)bench_store.size(),
+               (unsigned)(passing / SAX_BENCH_ATTEMPTS), (unsigned long)lookup_cycles, (unsigned long)exact_cycles);
+    }
+    printf("[bench] sax index: %u nodes, rebuilt in %lu, %d false dismissals\r\n", (unsigned)bench_index.nodes,
+           (unsigned long)build_cycles, dismissals);
+    bench_store.clear();
+    return dismissals;
+}
+
+CanonicalStats bench_query_stats; // sums of the attempt, shared by every key
+
+/*******************************************************************************
+ *
+ * @brief Cost of an unlocking scan with the key sums cached at enrollment
+ * Every attempt is correlated with every enrolled key twice: accumulating all five
+ * sums per key, and with the key sums from enrollment plus the attempt sums taken
+ * once, which leaves only the cross term per key
+ * @return the number of correlations that are not bit-identical between both
+ *
+ * ****************************************************************************/
+int BenchmarkCachedKeyStats()
+{
+    int mismatches = 0;
+    uint32_t full_cycles = 0, cached_cycles = 0;
+
+    bench_store.clear();
+    for (size_t count = 0; count < TEMPLATE_CAPACITY; count++)
+    {
+        FillSyntheticGesture(bench_record, count + 1, 1.5f * count);
+        add_template(bench_store, bench_record, RECORD_CAPACITY / 10);
+    }
+
+    for (uint32_t a = 0; a < ENROLL_BENCH_ATTEMPTS; a++)
+    {
+        FillSyntheticGesture(bench_query, 500 + a, 1.5f * (a % TEMPLATE_CAPACITY) + 0.05f * (a % 7));
+        resample_canonical(bench_canonical[1], bench_query);
+
+        array<float, 3> full[TEMPLATE_CAPACITY], cached[TEMPLATE_CAPACITY];
+        uint32_t start = CycleCounterRead();
+        for (size_t k = 0; k < bench_store.size(); k++)
+        {
+            full[k] = correlation_canonical_q7(bench_store[k].canonical, bench_canonical[1]);
+        }
+        full_cycles += CycleCounterRead() - start;
+
+        start = CycleCounterRead();
+        canonical_stats(bench_query_stats, bench_canonical[1]);
+        for (size_t k = 0; k < bench_store.size(); k++)
+        {
+            cached[k] = correlation_canonical_q7(bench_store[k].canonical, bench_store[k].canonical_stats,
+                                                 bench_canonical[1], bench_query_stats);
+        }
+        cached_cycles += CycleCounterRead() - start;
+
+        for (size_t k = 0; k < bench_store.size(); k++)
+        {
+            mismatches += full[k] != cached[k];
+        }
+    }
+
+    printf("[bench] cached key sums: %u keys, %u attempts, all sums %lu, cached %lu, %d mismatches\r\n",
+           (unsigned)bench_store.size(), (unsigned)ENROLL_BENCH_ATTEMPTS, (unsigned long)full_cycles,
+           (unsigned long)cached_cycles, mismatches);
+    bench_store.clear();
+    return mismatches;
+}
+
+#define DSP_BENCH_LENGTH RECORD_CAPACITY
+#define DSP_BENCH_ROUNDS 64
+
+int16_t dsp_bench_a[DSP_BENCH_LENGTH]; // random operands, edge values included
+int16_t dsp_bench_b[DSP_BENCH_LENGTH];
+int8_t dsp_bench_q7[DSP_BENCH_LENGTH];
+
+/*******************************************************************************
+ *
+ * @brief Check the DSP kernels bit-exact against their scalar references and time both
+ * Every round uses a new random length and new operands; the first rounds are
+ * filled with -32768 and 32767, where packed multiply-adds wrap or saturate
+ * @return the number of mismatching results
+ *
+ * ****************************************************************************/
+int BenchmarkDspKernels()
+{
+    uint32_t seed = 12345;
+    int mismatches = 0;
+    uint32_t ref_cycles[7] = {0, 0, 0, 0, 0, 0, 0};
+    uint32_t dsp_cycles[7] = {0, 0, 0, 0, 0, 0, 0};
+    const char *names[7] = {"dot", "sum of squares", "correlation sums", "L1 cost", "L2 cost", "q7 correlation sums", "q7 dot"};
+
+    for (int round = 0; round < DSP_BENCH_ROUNDS; round++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        size_t n = round < 4 ? DSP_BENCH_LENGTH : (seed >> 8) % (DSP_BENCH_LENGTH + 1);
+        for (size_t i = 0; i < DSP_BENCH_LENGTH; i++)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            dsp_bench_a[i] = round == 0 || round == 2 ? -32768 : round == 1 ? 32767 : (int16_t)(seed >> 16);
+            dsp_bench_b[i] = round == 0 || round == 1 ? -32768 : round == 2 ? 32767 : (int16_t)seed;
+            dsp_bench_q7[i] = round == 0 || round == 2 ? -128 : round == 1 ? 127 : (int8_t)(seed >> 24);
+        }
+
+        uint32_t start = CycleCounterRead();
+        int64_t dot_ref = dot_q15_ref(dsp_bench_a, dsp_bench_b, n);
+        ref_cycles[0] += CycleCounterRead() - start;
+        start = CycleCounterRead();
+        int64_t dot = dot_q15(dsp_bench_a, dsp_bench_b, n);
+        dsp_cycles[0] += CycleCounterRead() - start;
+        mismatches += dot != dot_ref;
+
+        start = CycleCounterRead();
+        int64_t sq_ref = sum_squares_q15_ref(dsp_bench_a, n);
+        ref_cycles[1] += CycleCounterRead() - start;
+        start = CycleCounterRead();
+        int64_t sq = sum_squares_q15(dsp_bench_a, n);
+        dsp_cycles[1] += CycleCounterRead() - start;
+        mismatches += sq != sq_ref;
+
+        CorrelationSums sums_ref, sums;
+        start = CycleCounterRead();
+        correlation_sums_q15_ref(dsp_bench_a, dsp_bench_b, n, sums_ref);
+        ref_cycles[2] += CycleCounterRead() - start;
+        start = CycleCounterRead();
+        correlation_sums_q15(dsp_bench_a, dsp_bench_b, n, sums);
+        dsp_cycles[2] += CycleCounterRead() - start;
+        mismatches += sums.sum_a != sums_ref.sum_a || sums.sum_b != sums_ref.sum_b || sums.sum_ab != sums_ref.sum_ab ||
+                      sums.sq_sum_a != sums_ref.sq_sum_a || sums.sq_sum_b != sums_ref.sq_sum_b;
+
+        start = CycleCounterRead();
+        uint32_t l1_ref = frame_cost_l1_ref(dsp_bench_a, dsp_bench_b, n);
+        ref_cycles[3] += CycleCounterRead() - start;
+        start = CycleCounterRead();
+        uint32_t l1 = frame_cost_l1(dsp_bench_a, dsp_bench_b, n);
+        dsp_cycles[3] += CycleCounterRead() - start;
+        mismatches += l1 != l1_ref;
+
+        start = CycleCounterRead();
+        uint64_t l2_ref = frame_cost_l2_ref(dsp_bench_a, dsp_bench_b, n);
+        ref_cycles[4] += CycleCounterRead() - start;
+        start = CycleCounterRead();
+        uint64_t l2 = frame_cost_l2(dsp_bench_a, dsp_bench_b, n);
+        dsp_cycles[4] += CycleCounterRead() - start;
+        mismatches += l2 != l2_ref;
+
+        start = CycleCounterRead();
+        correlation_sums_q7_q15_ref(dsp_bench_q7, dsp_bench_b, n, sums_ref);
+        ref_cycles[5] += CycleCounterRead() - start;
+        start = CycleCounterRead();
+        correlation_sums_q7_q15(dsp_bench_q7, dsp_bench_b, n, sums);
+        dsp_cycles[5] += CycleCounterRead() - start;
+        mismatches += sums.sum_a != sums_ref.sum_a || sums.sum_b != sums_ref.sum_b || sums.sum_ab != sums_ref.sum_ab ||
+                      sums.sq_sum_a != sums_ref.sq_sum_a || sums.sq_sum_b != sums_ref.sq_sum_b;
+
+        start = CycleCounterRead();
+        int64_t dot_q7_ref = dot_q7_q15_ref(dsp_bench_q7, dsp_bench_b, n);
+        ref_cycles[6] += CycleCounterRead() - start;
+        start = CycleCounterRead();
+        int64_t dot_q7 = dot_q7_q15(dsp_bench_q7, dsp_bench_b, n);
+        dsp_cycles[6] += CycleCounterRead() - start;
+        mismatches += dot_q7 != dot_q7_ref;
+    }
+
+    for (int k = 0; k < 7; k++)
+    {
+        printf("[bench] %s: scalar %lu, dsp %lu over %d rounds\r\n", names[k], (unsigned long)ref_cycles[k],
+               (unsigned long)dsp_cycles[k], DSP_BENCH_ROUNDS);
+    }
+    printf("[bench] dsp kernels: %d mismatches\r\n", mismatches);
+    return mismatches;
+}
+
+#define FILTER_BENCH_LENGTH 1024 // samples per stage, with a spike every 37 and silence at the end
+#define FILTER_BENCH_SILENCE 256
+
+GestureSample filter_bench_in[FILTER_BENCH_LENGTH];
+
+/*******************************************************************************
+ *
+ * @brief Run one filter stage over the benchmark input
+ * @param stage: the stage, reset first
+ * @param out: the filtered samples
+ * @return the cycles it took per sample
+ *
+ * ****************************************************************************/
+template <typename Stage>
+uint32_t TimeFilterStage(Stage &stage, GestureSample *out)
+{
+    stage.Reset();
+    uint32_t start = CycleCounterRead();
+    for (size_t i = 0; i < FILTER_BENCH_LENGTH; i++)
+    {
+        out[i] = stage.Process(filter_bench_in[i]);
+    }
+    return (CycleCounterRead() - start) / FILTER_BENCH_LENGTH;
+}
+
+GestureSample filter_bench_out[FILTER_BENCH_LENGTH];
+MovingAverage<8> bench_moving_average;
+MedianFilter<5> bench_median;
+Biquad<BIQUAD_LOWPASS, 10, MATCH_RATE_HZ> bench_lowpass;
+Biquad<BIQUAD_HIGHPASS, 1, MATCH_RATE_HZ> bench_highpass;
+ExponentialSmoothing<2> bench_smoothing;
+FilterChain<MedianFilter<3>, Biquad<BIQUAD_LOWPASS, 10, MATCH_RATE_HZ>> bench_chain;
+
+/*******************************************************************************
+ *
+ * @brief Cycles per sample of every filter stage, checked against direct computations
+ * The moving average and the median are compared with the mean and the median of the
+ * window computed from scratch; every stage has to return exactly 0 once the input
+ * has been silent for a while
+ * @return the number of samples that differ from the direct computation, plus the stages that do not settle
+ *
+ * ****************************************************************************/
+int BenchmarkFilterStages()
+{
+    uint32_t seed = 777;
+    for (size_t i = 0; i < FILTER_BENCH_LENGTH; i++)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            float value = 8000.0f * sinf(0.05f * (axis + 1) * i) + (float)((int32_t)(seed >> 20) - 2048);
+            if (i % 37 == 0)
+            {
+                value = (seed & 1) ? 32767.0f : -32767.0f;
+            }
+            filter_bench_in[i][axis] = i < FILTER_BENCH_LENGTH - FILTER_BENCH_SILENCE ? (int16_t)value : 0;
+        }
+    }
+
+    int errors = 0;
+    uint32_t cycles = TimeFilterStage(bench_moving_average, filter_bench_out);
+    for (size_t i = 0; i < FILTER_BENCH_LENGTH; i++)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            int32_t sum = 0;
+            for (size_t k = 0; k < 8 && k <= i; k++)
+            {
+                sum += filter_bench_in[i - k][axis];
+            }
+            errors += filter_bench_out[i][axis] != filter_divide(sum, 8);
+        }
+    }
+    printf("[bench] filter moving average of 8: %lu per sample\r\n", (unsigned long)cycles);
+
+    cycles = TimeFilterStage(bench_median, filter_bench_out);
+    for (size_t i = 0; i < FILTER_BENCH_LENGTH; i++)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            int16_t window[5];
+            for (size_t k = 0; k < 5; k++)
+            {
+                window[k] = k <= i ? filter_bench_in[i - k][axis] : 0;
+            }
+            std::sort(window, window + 5);
+            errors += filter_bench_out[i][axis] != window[2];
+        }
+    }
+    printf("[bench] filter median of 5: %lu per sample\r\n", (unsigned long)cycles);
+
+    const char *names[4] = {"low-pass 10 Hz", "high-pass 1 Hz", "smoothing 1/4", "median 3 + low-pass chain"};
+    uint32_t stage_cycles[4];
+    int settled[4];
+    stage_cycles[0] = TimeFilterStage(bench_lowpass, filter_bench_out);
+    settled[0] = filter_bench_out[FILTER_BENCH_LENGTH - 1] == GestureSample{0, 0, 0};
+    stage_cycles[1] = TimeFilterStage(bench_highpass, filter_bench_out);
+    settled[1] = filter_bench_out[FILTER_BENCH_LENGTH - 1] == GestureSample{0, 0, 0};
+    stage_cycles[2] = TimeFilterStage(bench_smoothing, filter_bench_out);
+    settled[2] = filter_bench_out[FILTER_BENCH_LENGTH - 1] == GestureSample{0, 0, 0};
+    stage_cycles[3] = TimeFilterStage(bench_chain, filter_bench_out);
+    settled[3] = filter_bench_out[FILTER_BENCH_LENGTH - 1] == GestureSample{0, 0, 0};
+    for (int k = 0; k < 4; k++)
+    {
+        printf("[bench] filter %s: %lu per sample%s\r\n", names[k], (unsigned long)stage_cycles[k],
+               settled[k] ? "" : ", does not settle to 0");
+        errors += !settled[k];
+    }
+    printf("[bench] filter stages: %d errors\r\n", errors);
+    return errors;
+}
+
+#ifdef HOST_BUILD
+#define RING_BENCH_ITEMS 200000  // items the producer thread hands over
+#define RING_BENCH_BATCH 5       // largest batch pushed or popped at once, odd so batches straddle the wrap
+
+// Item with a check word, a torn copy does not match it
+typedef struct
+{
+    uint32_t sequence;
+    uint32_t check;
+} RingBenchItem;
+
+SpscRing<RingBenchItem, 64> bench_ring;
+
+/*******************************************************************************
+ *
+ * @brief Producer side of the ring stress check, pushes RING_BENCH_ITEMS items in order
+ * Single pushes and batches alternate; an item that does not fit is counted and retried
+ * @param rejected: receives the number of items the ring turned away
+ *
+ * ****************************************************************************/
+void RingBenchProducer(uint32_t *rejected)
+{
+    RingBenchItem batch[RING_BENCH_BATCH];
+    uint32_t next = 0;
+    uint32_t refused = 0;
+    while (next < RING_BENCH_ITEMS)
+    {
+        size_t count = 1 + next % RING_BENCH_BATCH;
+        if (count > RING_BENCH_ITEMS - next)
+        {
+            count = RING_BENCH_ITEMS - next;
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            batch[i] = {next + (uint32_t)i, (next + (uint32_t)i) * 2654435761u};
+        }
+        size_t written = count == 1 ? (size_t)bench_ring.Push(batch[0]) : bench_ring.Push(batch, count);
+        refused += (uint32_t)(count - written);
+        next += (uint32_t)written;
+        if (written < count)
+        {
+            std::this_thread::yield(); // full, let the consumer run on a single core
+        }
+    }
+    *rejected = refused;
+}
+
+/*******************************************************************************
+ *
+ * @brief Hand items from a producer thread to this one through SpscRing
+ * The consumer pops single items and batches and checks that every item arrives
+ * once, in order and untorn, and that the overrun counter matches the items the
+ * producer saw rejected
+ * @return the number of items lost, repeated, out of order or torn, plus 1 if the overrun count is off
+ *
+ * ****************************************************************************/
+int BenchmarkSampleRing()
+{
+    uint32_t rejected = 0;
+    uint32_t expected = 0;
+    int errors = 0;
+    RingBenchItem batch[RING_BENCH_BATCH];
+
+    uint32_t start = CycleCounterRead();
+    std::thread producer(RingBenchProducer, &rejected);
+    while (expected < RING_BENCH_ITEMS)
+    {
+        size_t count = expected % 2 ? bench_ring.Pop(batch, RING_BENCH_BATCH) : (size_t)bench_ring.Pop(batch[0]);
+        if (count == 0)
+        {
+            std::this_thread::yield(); // empty, let the producer run on a single core
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            if (batch[i].sequence != expected || batch[i].check != expected * 2654435761u)
+            {
+                errors++;
+                expected = batch[i].sequence; // resynchronize so one fault is counted once
+            }
+            expected++;
+        }
+    }
+    producer.join();
+    uint32_t elapsed = CycleCounterRead() - start;
+
+    errors += !bench_ring.Empty();
+    errors += bench_ring.Overruns() != rejected;
+    printf("[bench] sample ring: %u items between two threads in %lu, %lu pushes rejected, %d errors\r\n",
+           (unsigned)RING_BENCH_ITEMS, (unsigned long)elapsed, (unsigned long)rejected, errors);
+    return errors;
+}
+#endif
+
+#ifdef HOST_BUILD
+int main()
+{
+    if (BenchmarkTemplateSearch() != 0)
+    {
+        return 1;
+    }
+    if (BenchmarkCrossCorrelation() != 0)
+    {
+        return 1;
+    }
+    if (BenchmarkEnrollment() != 0)
+    {
+        return 1;
+    }
+    if (BenchmarkOnlineMatch() != 0)
+    {
+        return 1;
+    }
+    if (BenchmarkQuantizedTemplates() != 0)
+    {
+        return 1;
+    }
+    if (BenchmarkSaxIndex() != 0)
+    {
+        return 1;
+    }
+    if (BenchmarkCachedKeyStats() != 0)
+    {
+        return 1;
+    }
+    if (BenchmarkDspKernels() != 0)
+    {
+        return 1;
+    }
+    if (BenchmarkFilterStages() != 0)
+    {
+        return 1;
+    }
+    if (BenchmarkSampleRing() != 0)
+    {
+        return 1;
+    }
+    return 0;
+}
+#endif
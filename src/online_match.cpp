@@ -0,0 +1,298 @@
+#include <limits>
+#include <cmath>
+#include "online_match.h"
+
+/*******************************************************************************
+ *
+ * @brief Start scoring a new attempt against the keys of a store
+ * @param matcher: the matcher to reset
+ * @param store: the enrolled keys, must not change until the attempt is decided; each
+ *               is matched with the DTW band its envelope was built for, like match_templates()
+ * @param threshold: the normalized DTW distance to accept, keys beyond it are abandoned
+ *
+ * ****************************************************************************/
+void online_match_reset(OnlineMatcher &matcher, const TemplateStore &store, float threshold)
+{
+    const float inf = numeric_limits<float>::infinity();
+    matcher.store = &store;
+    matcher.threshold = threshold;
+    matcher.length = 0;
+    matcher.pending_zeros = 0;
+    matcher.started = false;
+
+    for (size_t k = 0; k < store.size(); ++k)
+    {
+        size_t m = store[k].samples.size();
+        size_t band = store[k].band;
+        matcher.width[k][0] = band > ONLINE_LENGTH_LIMIT ? band - ONLINE_LENGTH_LIMIT : 0;
+        matcher.width[k][1] = band + ONLINE_LENGTH_LIMIT;
+        for (int w = 0; w < 2; ++w)
+        {
+            float *row = matcher.rows[k][w][0];
+            row[0] = 0;
+            for (size_t j = 1; j <= min(m, matcher.width[k][w] + 1); ++j)
+            {
+                row[j] = inf;
+            }
+            matcher.row_min[k][w] = 0;
+        }
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            matcher.sums[k][axis] = CorrelationSums();
+        }
+    }
+}
+
+/*******************************************************************************
+ *
+ * @brief Largest DTW row cost a key can still be accepted with
+ * The attempt is at most ONLINE_LENGTH_LIMIT longer than the key when it is decided
+ * @param matcher: the matcher
+ * @param m: length of the key
+ * @return the limit on the cost of every row
+ *
+ * ****************************************************************************/
+float online_match_limit(const OnlineMatcher &matcher, size_t m)
+{
+    return matcher.threshold * (2 * m + ONLINE_LENGTH_LIMIT);
+}
+
+/*******************************************************************************
+ *
+ * @brief Advance the DTW rows and the correlation sums of every key by one sample
+ * @param matcher: the matcher
+ * @param sample: the next sample of the attempt, after trimming
+ *
+ * ****************************************************************************/
+void online_match_step(OnlineMatcher &matcher, const GestureSample &sample)
+{
+    const float inf = numeric_limits<float>::infinity();
+    const TemplateStore &store = *matcher.store;
+    size_t i = ++matcher.length;
+
+    for (size_t k = 0; k < store.size(); ++k)
+    {
+        const GestureRecord &key = store[k].samples;
+        const GestureRecord *spread = key_spread(store[k]);
+        size_t m = key.size();
+
+        // correlation over the samples both recordings have
+        if (i <= m)
+        {
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                int32_t va = key[i - 1][axis];
+                int32_t vb = sample[axis];
+                CorrelationSums &sums = matcher.sums[k][axis];
+                sums.sum_a += va;
+                sums.sum_b += vb;
+                sums.sum_ab += va * vb;
+                sums.sq_sum_a += va * va;
+                sums.sq_sum_b += vb * vb;
+            }
+        }
+
+        for (int w = 0; w < 2; ++w)
+        {
+            // every path crosses each row, a band whose row is above the limit stays rejected
+            if (matcher.row_min[k][w] > online_match_limit(matcher, m))
+            {
+                continue;
+            }
+
+            // the cells are those of dtw(key, attempt) with the band fixed to the diagonal
+            size_t width = matcher.width[k][w];
+            float *prev = matcher.rows[k][w][(i - 1) & 1];
+            float *curr = matcher.rows[k][w][i & 1];
+            size_t lo = i > width ? i - width : 1;
+            size_t hi = min(m, i + width);
+            float row_min = inf;
+            if (lo <= m)
+            {
+                curr[lo - 1] = inf;
+                for (size_t j = lo; j <= hi; ++j)
+                {
+                    float cost = spread == nullptr ? euclidean_distance(key[j - 1], sample)
+                                                   : envelope_distance(key[j - 1], sample, (*spread)[j - 1]);
+                    curr[j] = cost + min({prev[j], curr[j - 1], prev[j - 1]});
+                    row_min = min(row_min, curr[j]);
+                }
+                // the next row reaches one cell further to the right
+                if (hi < m)
+                {
+                    curr[hi + 1] = inf;
+                }
+            }
+            matcher.row_min[k][w] = row_min; // infinity once the attempt outgrew the band
+        }
+    }
+}
+
+/*******************************************************************************
+ *
+ * @brief Feed one recorded sample into the matcher
+ * Zero samples are held back and only applied once motion follows them, so the
+ * trailing ones never reach the matcher and the leading ones are dropped
+ * @param matcher: the matcher
+ * @param sample: the next decimated, calibrated sample
+ *
+ * ****************************************************************************/
+void online_match_push(OnlineMatcher &matcher, const GestureSample &sample)
+{
+    const GestureSample zero = {0, 0, 0};
+    if (sample == zero)
+    {
+        if (matcher.started)
+        {
+            matcher.pending_zeros++;
+        }
+        return;
+    }
+    matcher.started = true;
+    for (; matcher.pending_zeros > 0; matcher.pending_zeros--)
+    {
+        online_match_step(matcher, zero);
+    }
+    online_match_step(matcher, sample);
+}
+
+/*******************************************************************************
+ *
+ * @brief The key match_templates() returns for the attempt, from the online rows where they tell
+ * For every key the narrow band gives an upper and the wide band a lower bound of
+ * the batch distance. Keys whose lower bound is above the threshold are rejected;
+ * the best remaining key is taken if its upper bound is within the threshold and
+ * below the lower bound of every other remaining key. Keys more than
+ * ONLINE_LENGTH_LIMIT longer or shorter than the attempt have no online rows and
+ * start from LB_Kim and LB_Keogh instead. Whenever the bounds can not decide, the
+ * batch dtw() of one of the keys in question replaces its bounds, so the verdict
+ * is always the one of the batch matcher
+ * @param matcher: the matcher
+ * @param query: the trimmed attempt, the samples the matcher was fed
+ * @param distance: the DTW distance of the returned key, an upper bound if it was decided online; infinity if none
+ * @param resolved: the number of keys that needed the batch dtw()
+ * @return the index of the best key, -1 if none is below the threshold
+ *
+ * ****************************************************************************/
+int online_match_dtw(const OnlineMatcher &matcher, const GestureRecord &query, float &distance, size_t &resolved)
+{
+    const float inf = numeric_limits<float>::infinity();
+    const TemplateStore &store = *matcher.store;
+    size_t n = matcher.length;
+    float lower[TEMPLATE_CAPACITY], upper[TEMPLATE_CAPACITY];
+    distance = inf;
+    resolved = 0;
+
+    for (size_t k = 0; k < store.size(); ++k)
+    {
+        const GestureKey &key = store[k];
+        size_t m = key.samples.size();
+        if (n == 0 || m == 0)
+        {
+            lower[k] = upper[k] = inf; // dtw() has no path either
+        }
+        else if ((n > m ? n - m : m - n) > ONLINE_LENGTH_LIMIT || n / m + 1 > key.band)
+        {
+            // the bands only bracket the band of dtw() close to the key length and where dtw() keeps it,
+            // beyond that the lower bounds of match_templates() stand in until the batch DTW is needed
+            lower[k] = max(lb_kim(key.samples, query, key_spread(key)), lb_keogh(key, query));
+            upper[k] = inf;
+        }
+        else
+        {
+            for (int w = 0; w < 2; ++w)
+            {
+                bool open = (n > m ? n - m : m - n) <= matcher.width[k][w] &&
+                            matcher.row_min[k][w] <= online_match_limit(matcher, m);
+                float bound = open ? matcher.rows[k][w][n & 1][m] / (n + m) : inf;
+                (w == 0 ? upper[k] : lower[k]) = bound;
+            }
+        }
+    }
+
+    for (;;)
+    {
+        int best = -1;
+        for (size_t k = 0; k < store.size(); ++k)
+        {
+            if (lower[k] <= matcher.threshold && (best < 0 || upper[k] < upper[best]))
+            {
+                best = k;
+            }
+        }
+        if (best < 0)
+        {
+            return -1; // every key is above the threshold
+        }
+
+        // the best key has to beat the threshold and every other key that may pass
+        int open = -1;
+        if (!(upper[best] <= matcher.threshold))
+        {
+            open = best;
+        }
+        for (size_t k = 0; k < store.size() && open < 0; ++k)
+        {
+            if ((int)k != best && lower[k] <= matcher.threshold && !(upper[best] < lower[k]))
+            {
+                open = lower[best] < upper[best] ? best : k;
+            }
+        }
+        if (open < 0)
+        {
+            distance = upper[best];
+            return best;
+        }
+
+        // the bounds of a key can not tell, replace them with its batch distance
+        if (!(lower[open] < upper[open]))
+        {
+            // both exact and equal, match_templates() would keep either one
+            distance = upper[best];
+            return best;
+        }
+        const GestureKey &key = store[open];
+        lower[open] = upper[open] = dtw(key.samples, query, key.band, matcher.threshold, key_spread(key));
+        resolved++;
+    }
+}
+
+/*******************************************************************************
+ *
+ * @brief Key whose weakest axis correlates best, as long as all three axes are above the threshold
+ * Keys that share fewer than min_overlap() samples with the attempt are skipped
+ * @param matcher: the matcher
+ * @param threshold: the correlation every axis has to exceed
+ * @param result: the correlation of each axis of the best key tried
+ * @return the index of the matching key, -1 if none
+ *
+ * ****************************************************************************/
+int online_match_correlation(const OnlineMatcher &matcher, float threshold, array<float, 3> &result)
+{
+    const TemplateStore &store = *matcher.store;
+    float best_score = -numeric_limits<float>::infinity();
+    int best = -1;
+    result = {0.0f, 0.0f, 0.0f};
+
+    for (size_t k = 0; k < store.size(); ++k)
+    {
+        int64_t n = min(matcher.length, store[k].samples.size());
+        if (n < (int64_t)min_overlap(matcher.length, store[k].samples.size()))
+        {
+            continue;
+        }
+        array<float, 3> values;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            correlation_from_sums(matcher.sums[k][axis], n, values[axis]);
+        }
+        float score = min(values[0], min(values[1], values[2]));
+        if (score > best_score)
+        {
+            best_score = score;
+            best = k;
+            result = values;
+        }
+    }
+    return best_score > threshold ? best : -1;
+}
@@ -0,0 +1,37 @@
+#ifndef __ONLINE_MATCH_H
+#define __ONLINE_MATCH_H
+
+#include "gesture.h"
+#include "dsp_kernels.h"
+
+// Largest difference between the attempt and the key length the online DTW can decide, 0.2 s at 50 Hz
+#define ONLINE_LENGTH_LIMIT (MATCH_RATE_HZ / 5)
+
+// Streaming matcher: scores an unlocking attempt against every key while it is recorded
+// Each sample advances DTW rows and the running correlation sums of every key, so the
+// decision is ready as soon as the recording ends instead of after a full pass.
+// Leading and trailing zero samples are skipped exactly like trim_gyro_data() would.
+// The band of dtw() follows the diagonal to the end cell, which is unknown until the
+// recording ends. Within ONLINE_LENGTH_LIMIT of the key length that band lies between
+// |i - j| <= band - limit and |i - j| <= band + limit, so both are advanced: the narrow
+// one bounds the batch distance from above, the wide one from below. Only keys the bounds
+// can not decide, or whose length is too far from the attempt, run the batch DTW.
+typedef struct
+{
+    const TemplateStore *store;
+    float rows[TEMPLATE_CAPACITY][2][2][RECORD_CAPACITY + 1]; // two DTW rows per key and band, 16 KB
+    float row_min[TEMPLATE_CAPACITY][2];                      // smallest cost of the last row per band
+    CorrelationSums sums[TEMPLATE_CAPACITY][3];               // running correlation sums per key and axis
+    size_t width[TEMPLATE_CAPACITY][2];                       // narrow and wide band around the key's band, |i - j| <= width
+    float threshold;                                          // normalized DTW distance to accept
+    size_t length;                                            // samples fed into the matcher
+    size_t pending_zeros;                                     // zero samples held back until the next motion
+    bool started;                                             // the first non-zero sample arrived
+} OnlineMatcher;
+
+void online_match_reset(OnlineMatcher &matcher, const TemplateStore &store, float threshold);
+void online_match_push(OnlineMatcher &matcher, const GestureSample &sample);
+int online_match_dtw(const OnlineMatcher &matcher, const GestureRecord &query, float &distance, size_t &resolved);
+int online_match_correlation(const OnlineMatcher &matcher, float threshold, array<float, 3> &result);
+
+#endif
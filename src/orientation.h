@@ -0,0 +1,157 @@
+#ifndef __ORIENTATION_H
+#define __ORIENTATION_H
+
+#include <stdint.h>
+#include <math.h>
+#include "gesture.h"
+
+#define ORIENTATION_ONE (1 << 30)   // 1.0 in the Q30 quaternion
+#define ORIENTATION_ANGLE_STEP 0.1f // degrees per count of the cumulative angle feature, +-3276 degrees
+
+// Streaming orientation integrator for calibrated angular rates
+// Keeps the orientation relative to the first sample as a Q30 unit quaternion. Every sample
+// rotates it by the body-frame increment dq = (1 - |h|^2 / 2, h), h the half angles of the
+// sample (second order in the angle), and one Newton step pulls the norm back to 1, so the
+// rounding never accumulates. The step comes from the sensitivity and the sample rate, the
+// same code works at any full scale and any decimation. The per-axis cumulative angle is
+// the exact integer sum of the rates.
+class OrientationIntegrator
+{
+public:
+    // What Integrate() writes per sample
+    enum Feature
+    {
+        FEATURE_QUATERNION, // vector part of the quaternion, sin(angle / 2) * axis in Q15
+        FEATURE_ANGLE       // cumulative angle of each axis in ORIENTATION_ANGLE_STEP
+    };
+
+    OrientationIntegrator()
+    {
+        Reset(0.0175f, MATCH_RATE_HZ);
+    }
+
+    // Back to the identity, with the sensitivity in dps per count and the sample rate in Hz
+    void Reset(float sensitivity, uint16_t rate_hz)
+    {
+        if (rate_hz < 1)
+            rate_hz = 1;
+        // half the angle in radians one count turns in one period, Q40 keeps ~17 significant bits at any setting
+        half_angle_q40 = (int32_t)lroundf(sensitivity * (float)M_PI / 180.0f / rate_hz / 2.0f * 1099511627776.0f);
+        count_to_step = sensitivity / rate_hz / ORIENTATION_ANGLE_STEP;
+        seconds_per_sample = 1.0f / rate_hz;
+        Restart();
+    }
+
+    // Back to the identity, keeping the sensitivity and the rate
+    void Restart()
+    {
+        q[0] = ORIENTATION_ONE;
+        q[1] = q[2] = q[3] = 0;
+        for (int axis = 0; axis < 3; axis++)
+            angle[axis] = 0;
+        travelled = 0.0f;
+        samples = 0;
+    }
+
+    // Feed one calibrated sample in raw counts
+    void Process(const GestureSample &rate)
+    {
+        int32_t h[3];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            h[axis] = (int32_t)(((int64_t)rate[axis] * half_angle_q40) >> 10); // Q30 half angle
+            angle[axis] += rate[axis];
+        }
+        int64_t h2 = (int64_t)h[0] * h[0] + (int64_t)h[1] * h[1] + (int64_t)h[2] * h[2]; // Q60
+        int32_t dw = ORIENTATION_ONE - (int32_t)(h2 >> 31);                           // 1 - |h|^2 / 2
+        travelled += 2.0f * sqrtf((float)h2) / ORIENTATION_ONE;
+
+        // q = q * dq, the rates are measured in the body frame
+        int64_t w = (int64_t)q[0] * dw - (int64_t)q[1] * h[0] - (int64_t)q[2] * h[1] - (int64_t)q[3] * h[2];
+        int64_t x = (int64_t)q[0] * h[0] + (int64_t)q[1] * dw + (int64_t)q[2] * h[2] - (int64_t)q[3] * h[1];
+        int64_t y = (int64_t)q[0] * h[1] - (int64_t)q[1] * h[2] + (int64_t)q[2] * dw + (int64_t)q[3] * h[0];
+        int64_t z = (int64_t)q[0] * h[2] + (int64_t)q[1] * h[1] - (int64_t)q[2] * h[0] + (int64_t)q[3] * dw;
+        q[0] = Round(w);
+        q[1] = Round(x);
+        q[2] = Round(y);
+        q[3] = Round(z);
+
+        // renormalize: |q| is within a few LSB of 1, one Newton step of 1/sqrt(n) = (3 - n) / 2 is enough
+        int64_t n = ((int64_t)q[0] * q[0] + (int64_t)q[1] * q[1] + (int64_t)q[2] * q[2] + (int64_t)q[3] * q[3]) >> 30;
+        int64_t factor = (3 * (int64_t)ORIENTATION_ONE - n) >> 1;
+        for (int i = 0; i < 4; i++)
+            q[i] = Round(q[i] * factor);
+        samples++;
+    }
+
+    // The quaternion w, x, y, z in Q30
+    const int32_t *Quaternion() const
+    {
+        return q;
+    }
+
+    // Rotation from the first sample in radians
+    float Angle() const
+    {
+        return 2.0f * acosf(fminf(fabsf((float)q[0] / ORIENTATION_ONE), 1.0f));
+    }
+
+    // Cumulative angle of an axis in degrees
+    float AxisAngle(int axis) const
+    {
+        return angle[axis] * count_to_step * ORIENTATION_ANGLE_STEP;
+    }
+
+    // Total rotation along the way in radians, times the lever arm it is the distance travelled
+    float TravelledAngle() const
+    {
+        return travelled;
+    }
+
+    // Time integrated so far in seconds
+    float Duration() const
+    {
+        return samples * seconds_per_sample;
+    }
+
+    // The feature of the current orientation
+    GestureSample Output(Feature kind) const
+    {
+        GestureSample out;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float value = kind == FEATURE_QUATERNION ? q[axis + 1] / 32768.0f : angle[axis] * count_to_step;
+            out[axis] = (int16_t)fminf(fmaxf(roundf(value), -32767.0f), 32767.0f);
+        }
+        return out;
+    }
+
+    // Replace a recording of rates by its orientation features, in place if both are the same record
+    void Integrate(GestureRecord &features, const GestureRecord &rates, Feature kind)
+    {
+        Restart();
+        features.resize(rates.size());
+        for (size_t i = 0; i < rates.size(); i++)
+        {
+            Process(rates[i]);
+            features[i] = Output(kind);
+        }
+    }
+
+private:
+    // Q60 to Q30 rounded to nearest
+    static int32_t Round(int64_t value)
+    {
+        return (int32_t)((value + (1 << 29)) >> 30);
+    }
+
+    int32_t q[4];           // w, x, y, z in Q30
+    int32_t angle[3];       // sum of the rates in counts
+    int32_t half_angle_q40; // half angle per count and sample, Q40 radians
+    float count_to_step;    // counts * samples to ORIENTATION_ANGLE_STEP
+    float seconds_per_sample;
+    float travelled;        // sum of the rotation of every sample in radians
+    uint32_t samples;
+};
+
+#endif
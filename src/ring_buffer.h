@@ -0,0 +1,116 @@
+#ifndef __RING_BUFFER_H
+#define __RING_BUFFER_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Wait-free single-producer/single-consumer ring buffer
+// The producer (an ISR or SPI callback) only writes `head`, the consumer thread only writes `tail`,
+// so neither side ever blocks or disables interrupts. Indices run freely and are masked on access,
+// which is why the capacity has to be a power of two.
+// Does not depend on mbed so it can be built and stress tested on a host.
+template <typename T, size_t N>
+class SpscRing
+{
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscRing capacity must be a power of two");
+
+public:
+    SpscRing() : head(0), tail(0), overrun_count(0) {}
+
+    // Producer: append one item, returns false and counts an overrun if the ring is full
+    bool Push(const T &item)
+    {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) >= N)
+        {
+            overrun_count.store(overrun_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return false;
+        }
+        buffer[h & (N - 1)] = item;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Producer: append up to `count` items, returns the number of items written
+    // Every item that does not fit is counted as an overrun
+    size_t Push(const T *items, size_t count)
+    {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        size_t space = N - (h - tail.load(std::memory_order_acquire));
+        size_t n = count < space ? count : space;
+        for (size_t i = 0; i < n; i++)
+        {
+            buffer[(h + i) & (N - 1)] = items[i];
+        }
+        head.store(h + n, std::memory_order_release);
+        if (n < count)
+        {
+            overrun_count.store(overrun_count.load(std::memory_order_relaxed) + (count - n), std::memory_order_relaxed);
+        }
+        return n;
+    }
+
+    // Consumer: remove one item, returns false if the ring is empty
+    bool Pop(T &item)
+    {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        if (head.load(std::memory_order_acquire) == t)
+        {
+            return false;
+        }
+        item = buffer[t & (N - 1)];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer: remove up to `max_count` items in one batch, returns the number of items read
+    size_t Pop(T *items, size_t max_count)
+    {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        size_t available = head.load(std::memory_order_acquire) - t;
+        size_t n = max_count < available ? max_count : available;
+        for (size_t i = 0; i < n; i++)
+        {
+            items[i] = buffer[(t + i) & (N - 1)];
+        }
+        tail.store(t + n, std::memory_order_release);
+        return n;
+    }
+
+    // Number of queued items, exact only when called from one of the two sides
+    size_t Size() const
+    {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    bool Empty() const
+    {
+        return Size() == 0;
+    }
+
+    static constexpr size_t Capacity()
+    {
+        return N;
+    }
+
+    // Number of items dropped because the ring was full
+    uint32_t Overruns() const
+    {
+        return overrun_count.load(std::memory_order_relaxed);
+    }
+
+    // Consumer: drop everything queued, the producer may keep pushing
+    void Clear()
+    {
+        tail.store(head.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+private:
+    T buffer[N];
+    std::atomic<uint32_t> head;          // next slot to write, owned by the producer
+    std::atomic<uint32_t> tail;          // next slot to read, owned by the consumer
+    std::atomic<uint32_t> overrun_count; // written by the producer only
+};
+
+#endif
@@ -0,0 +1,150 @@
+#include <mbed.h>
+#include "sample_timing.h"
+
+GestureRecord resample_scratch; // output of ResampleUniform before it is copied back
+
+/*******************************************************************************
+ *
+ * @brief Nominal sample period in DWT cycles
+ * @param rate_hz: the sample rate
+ *
+ * ****************************************************************************/
+uint32_t PeriodInCycles(uint16_t rate_hz)
+{
+    return SystemCoreClock / rate_hz;
+}
+
+/*******************************************************************************
+ *
+ * @brief Clear the jitter statistics
+ * @param stats: the statistics to clear
+ *
+ * ****************************************************************************/
+void ResetJitterStats(SampleJitterStats *stats)
+{
+    memset(stats, 0, sizeof(SampleJitterStats));
+}
+
+/*******************************************************************************
+ *
+ * @brief Add one burst-to-burst interval to the histogram and the drift sums
+ * @param stats: the statistics to update
+ * @param interval: the measured and the nominal duration of the burst
+ *
+ * ****************************************************************************/
+void UpdateJitterStats(SampleJitterStats *stats, const BurstInterval &interval)
+{
+    if (interval.nominal == 0)
+    {
+        return;
+    }
+    uint32_t deviation = interval.measured > interval.nominal ? interval.measured - interval.nominal : interval.nominal - interval.measured;
+    uint32_t percent = (uint32_t)((uint64_t)deviation * 100 / interval.nominal);
+    uint32_t bin = percent / JITTER_BIN_PERCENT;
+    if (bin >= JITTER_BINS)
+    {
+        bin = JITTER_BINS - 1;
+    }
+    stats->histogram[bin]++;
+    stats->intervals++;
+    stats->max_percent = max(stats->max_percent, percent);
+    stats->max_deviation = max(stats->max_deviation, deviation);
+    stats->measured += interval.measured;
+    stats->nominal += interval.nominal;
+}
+
+/*******************************************************************************
+ *
+ * @brief Check if a burst interval deviated more than JITTER_RESAMPLE_PERCENT, or the
+ * sensor clock drifted more than DRIFT_RESAMPLE_PERCENT from the DWT over the recording
+ *
+ * ****************************************************************************/
+bool JitterExceedsBound(const SampleJitterStats *stats)
+{
+    uint64_t drift = stats->measured > stats->nominal ? stats->measured - stats->nominal : stats->nominal - stats->measured;
+    return stats->max_percent > JITTER_RESAMPLE_PERCENT || drift * 100 > stats->nominal * DRIFT_RESAMPLE_PERCENT;
+}
+
+/*******************************************************************************
+ *
+ * @brief Grid period on the sensor clock that matches `period` DWT cycles
+ * The samples are stamped at the nominal ODR, so a sensor clock running fast packs
+ * more of them into a DWT period and the grid has to widen by the same ratio
+ * @param stats: the statistics of the recording
+ * @param period: the grid period in DWT cycles
+ *
+ * ****************************************************************************/
+uint32_t DriftCorrectedPeriod(const SampleJitterStats *stats, uint32_t period)
+{
+    if (stats->measured == 0)
+    {
+        return period;
+    }
+    return (uint32_t)((uint64_t)period * stats->nominal / stats->measured);
+}
+
+/*******************************************************************************
+ *
+ * @brief Print the jitter histogram and the drift on the serial port
+ *
+ * ****************************************************************************/
+void PrintJitterStats(const SampleJitterStats *stats)
+{
+    int32_t drift_ppm = stats->nominal > 0 ? (int32_t)(((int64_t)stats->measured - (int64_t)stats->nominal) * 1000000 / (int64_t)stats->nominal) : 0;
+    printf("Jitter over %lu bursts, max %lu us, sensor clock drift %ld ppm:\r\n", (unsigned long)stats->intervals,
+           (unsigned long)(stats->max_deviation / (SystemCoreClock / 1000000)), (long)drift_ppm);
+    for (int bin = 0; bin < JITTER_BINS; bin++)
+    {
+        if (bin == JITTER_BINS - 1)
+            printf("  >=%2d%%: %lu\r\n", bin * JITTER_BIN_PERCENT, (unsigned long)stats->histogram[bin]);
+        else
+            printf("  <%3d%%: %lu\r\n", (bin + 1) * JITTER_BIN_PERCENT, (unsigned long)stats->histogram[bin]);
+    }
+}
+
+/*******************************************************************************
+ *
+ * @brief Resample a recording onto a uniform time grid by linear interpolation
+ * @param data: the recording, replaced by the resampled one
+ * @param times: the timestamp of every sample of `data`, increasing
+ * @param period: the grid period in cycles
+ *
+ * ****************************************************************************/
+void ResampleUniform(GestureRecord &data, const GestureTimes &times, uint32_t period)
+{
+    if (data.size() < 2 || times.size() != data.size())
+    {
+        return;
+    }
+
+    uint32_t start = times[0];
+    uint32_t span = times[times.size() - 1] - start; // unsigned difference survives a counter wrap
+    size_t j = 0;
+
+    resample_scratch.clear();
+    for (uint32_t t = 0; t <= span && !resample_scratch.full(); t += period)
+    {
+        // find the pair of samples around t
+        while (j + 2 < times.size() && times[j + 1] - start < t)
+        {
+            j++;
+        }
+        uint32_t t0 = times[j] - start;
+        uint32_t t1 = times[j + 1] - start;
+        int32_t weight = t1 > t0 ? (int32_t)(((uint64_t)(t - t0) << 14) / (t1 - t0)) : 0; // Q14
+        if (weight > (1 << 14))
+        {
+            weight = 1 << 14;
+        }
+
+        GestureSample sample;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            int32_t a = data[j][axis];
+            int32_t b = data[j + 1][axis];
+            sample[axis] = (int16_t)(a + (((b - a) * weight) >> 14));
+        }
+        resample_scratch.push_back(sample);
+    }
+    data = resample_scratch;
+}
@@ -0,0 +1,53 @@
+#ifndef __SAMPLE_TIMING_H
+#define __SAMPLE_TIMING_H
+
+#include <mbed.h>
+#include "gesture.h"
+
+#define JITTER_BINS 8               // histogram bins, the last one collects everything above
+#define JITTER_BIN_PERCENT 5        // width of a bin in percent of the nominal burst interval
+#define JITTER_RESAMPLE_PERCENT 20  // resample once a burst interval deviates more than this, one ODR period at the watermark is ~6%
+#define DRIFT_RESAMPLE_PERCENT 1    // resample once the sensor clock runs off the DWT by more than this over a recording
+
+// DWT cycle count timestamps of the samples of a GestureRecord
+typedef StaticVector<uint32_t, RECORD_CAPACITY> GestureTimes;
+
+// Gesture sample with its timestamp, e.g. in the pre-trigger buffer
+typedef struct
+{
+    GestureSample sample;
+    uint32_t timestamp;
+} TimedGestureSample;
+
+// DWT cycles between the starts of two consecutive FIFO bursts, and what the samples of the later one take at the nominal ODR
+typedef struct
+{
+    uint32_t measured;
+    uint32_t nominal;
+} BurstInterval;
+
+// Burst-to-burst interval statistics against the nominal ODR
+// The deviation of a single interval is thread latency, the sums show the drift of the sensor clock
+typedef struct
+{
+    uint32_t histogram[JITTER_BINS]; // intervals per deviation bin
+    uint32_t intervals;              // number of intervals seen
+    uint32_t max_percent;            // largest |measured - nominal| in percent of nominal
+    uint32_t max_deviation;          // largest |measured - nominal| in cycles
+    uint64_t measured;               // sum of the measured intervals
+    uint64_t nominal;                // sum of the nominal intervals
+} SampleJitterStats;
+
+// Nominal sample period in DWT cycles
+uint32_t PeriodInCycles(uint16_t rate_hz);
+
+void ResetJitterStats(SampleJitterStats *stats);
+void UpdateJitterStats(SampleJitterStats *stats, const BurstInterval &interval);
+bool JitterExceedsBound(const SampleJitterStats *stats);
+uint32_t DriftCorrectedPeriod(const SampleJitterStats *stats, uint32_t period);
+void PrintJitterStats(const SampleJitterStats *stats);
+
+// Resample a recording onto a uniform grid of `period` cycles starting at its first timestamp
+void ResampleUniform(GestureRecord &data, const GestureTimes &times, uint32_t period);
+
+#endif
@@ -0,0 +1,232 @@
+#include <cmath>
+#include "sax_index.h"
+
+// N(0, 1) quartiles, region s is [sax_breakpoints[s - 1], sax_breakpoints[s])
+const float sax_breakpoints[SAX_ALPHABET - 1] = {-0.6745f, 0.0f, 0.6745f};
+
+CanonicalAxes sax_key_scratch; // a key widened from int8 for its PAA
+
+/*******************************************************************************
+ *
+ * @brief z-normalized PAA of a canonical recording
+ * @param paa: the segment means of each axis in standard deviations, 0 for a flat axis
+ * @param in: the recording resampled to CANONICAL_LENGTH
+ *
+ * ****************************************************************************/
+void sax_paa(SaxPaa &paa, const CanonicalAxes &in)
+{
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        int32_t segment_sum[SAX_SEGMENTS];
+        int64_t sum = 0;
+        int64_t sq_sum = 0;
+        for (size_t s = 0; s < SAX_SEGMENTS; ++s)
+        {
+            int32_t segment = 0;
+            for (size_t k = s * SAX_SEGMENT_LENGTH; k < (s + 1) * SAX_SEGMENT_LENGTH; ++k)
+            {
+                segment += in.axis[axis][k];
+                sq_sum += (int32_t)in.axis[axis][k] * in.axis[axis][k];
+            }
+            segment_sum[s] = segment;
+            sum += segment;
+        }
+
+        // population standard deviation, the one the correlation normalizes with
+        float mean = (float)sum / CANONICAL_LENGTH;
+        float variance = (float)(CANONICAL_LENGTH * sq_sum - sum * sum) / ((float)CANONICAL_LENGTH * CANONICAL_LENGTH);
+        float scale = variance > 0.0f ? 1.0f / sqrtf(variance) : 0.0f;
+        for (size_t s = 0; s < SAX_SEGMENTS; ++s)
+        {
+            paa.segment[axis][s] = ((float)segment_sum[s] / SAX_SEGMENT_LENGTH - mean) * scale;
+        }
+    }
+}
+
+/*******************************************************************************
+ *
+ * @brief SAX word of a PAA, the region of the breakpoints each segment falls into
+ * @param word: the word to fill
+ * @param paa: the z-normalized PAA
+ *
+ * ****************************************************************************/
+void sax_word(SaxWord &word, const SaxPaa &paa)
+{
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        for (size_t s = 0; s < SAX_SEGMENTS; ++s)
+        {
+            uint8_t symbol = 0;
+            while (symbol < SAX_ALPHABET - 1 && paa.segment[axis][s] >= sax_breakpoints[symbol])
+            {
+                symbol++;
+            }
+            word.symbol[axis][s] = symbol;
+        }
+    }
+}
+
+/*******************************************************************************
+ *
+ * @brief Rebuild the index from the enrolled keys
+ * Bounded by SAX_MAX_NODES nodes and TEMPLATE_CAPACITY * (CANONICAL_LENGTH + SAX_DEPTH) steps
+ * @param index: the index to rebuild
+ * @param store: the enrolled keys
+ *
+ * ****************************************************************************/
+void sax_index_build(SaxIndex &index, const TemplateStore &store)
+{
+    index.nodes = 1;
+    index.keys = store.size();
+    for (size_t s = 0; s < SAX_ALPHABET; ++s)
+    {
+        index.child[0][s] = SAX_NONE;
+    }
+    index.leaf_key[0] = SAX_NONE;
+
+    for (size_t k = 0; k < store.size(); ++k)
+    {
+        // the word of the int8 key, exactly the values correlation_canonical_q7 correlates
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            for (size_t i = 0; i < CANONICAL_LENGTH; ++i)
+            {
+                sax_key_scratch.axis[axis][i] = store[k].canonical.axis[axis][i];
+            }
+        }
+        SaxPaa paa;
+        sax_paa(paa, sax_key_scratch);
+        sax_word(index.words[k], paa);
+
+        size_t node = 0;
+        for (size_t level = 0; level < SAX_DEPTH; ++level)
+        {
+            uint8_t symbol = index.words[k].symbol[level % 3][level / 3];
+            if (index.child[node][symbol] == SAX_NONE)
+            {
+                size_t added = index.nodes++;
+                for (size_t s = 0; s < SAX_ALPHABET; ++s)
+                {
+                    index.child[added][s] = SAX_NONE;
+                }
+                index.leaf_key[added] = SAX_NONE;
+                index.child[node][symbol] = added;
+            }
+            node = index.child[node][symbol];
+        }
+        index.next_key[k] = index.leaf_key[node];
+        index.leaf_key[node] = k;
+    }
+}
+
+/*******************************************************************************
+ *
+ * @brief Distance of a PAA value to the region of a symbol
+ * @param value: the PAA value
+ * @param symbol: the symbol
+ * @return the distance to the nearest breakpoint of the region, 0 inside it
+ *
+ * ****************************************************************************/
+float sax_mindist(float value, uint8_t symbol)
+{
+    if (symbol > 0 && value < sax_breakpoints[symbol - 1])
+    {
+        return sax_breakpoints[symbol - 1] - value;
+    }
+    if (symbol < SAX_ALPHABET - 1 && value > sax_breakpoints[symbol])
+    {
+        return value - sax_breakpoints[symbol];
+    }
+    return 0.0f;
+}
+
+/*******************************************************************************
+ *
+ * @brief Depth-first walk of the trie, marks the keys of every leaf within the limit
+ * @param index: the index
+ * @param node: the current node
+ * @param level: its depth
+ * @param cost: the squared MINDIST of every symbol on every level
+ * @param sums: the squared MINDIST of each axis down to this node
+ * @param limit: the largest squared MINDIST per axis that can still pass
+ * @param found: set for every key reached
+ *
+ * ****************************************************************************/
+void sax_search(const SaxIndex &index, size_t node, size_t level, const float (*cost)[SAX_ALPHABET], float *sums, float limit, bool *found)
+{
+    if (level == SAX_DEPTH)
+    {
+        for (uint16_t k = index.leaf_key[node]; k != SAX_NONE; k = index.next_key[k])
+        {
+            found[k] = true;
+        }
+        return;
+    }
+
+    int axis = level % 3;
+    float sum = sums[axis];
+    for (uint8_t symbol = 0; symbol < SAX_ALPHABET; ++symbol)
+    {
+        uint16_t child = index.child[node][symbol];
+        if (child == SAX_NONE)
+        {
+            continue;
+        }
+        sums[axis] = sum + cost[level][symbol];
+        if (sums[axis] <= limit)
+        {
+            sax_search(index, child, level + 1, cost, sums, limit, found);
+        }
+    }
+    sums[axis] = sum;
+}
+
+/*******************************************************************************
+ *
+ * @brief Keys whose correlation with the attempt may exceed the threshold on every axis
+ * For z-normalized recordings the squared distance is 2 N (1 - r), and the PAA scales
+ * MINDIST^2 by N / SAX_SEGMENTS, so an axis can only pass while its sum of squared
+ * MINDISTs stays at or below 2 SAX_SEGMENTS (1 - threshold)
+ * @param index: the index of the keys
+ * @param query: the attempt resampled to CANONICAL_LENGTH
+ * @param threshold: the correlation every axis has to exceed
+ * @param candidates: filled with the indices of the candidate keys in ascending order, TEMPLATE_CAPACITY entries
+ * @return the number of candidates
+ *
+ * ****************************************************************************/
+size_t sax_index_lookup(const SaxIndex &index, const CanonicalAxes &query, float threshold, size_t *candidates)
+{
+    if (index.keys == 0 || index.nodes == 0)
+    {
+        return 0; // empty, or never built
+    }
+
+    SaxPaa paa;
+    sax_paa(paa, query);
+
+    // the trie shares prefixes, the distance of every symbol on every level is needed at most once
+    float cost[SAX_DEPTH][SAX_ALPHABET];
+    for (size_t level = 0; level < SAX_DEPTH; ++level)
+    {
+        for (uint8_t symbol = 0; symbol < SAX_ALPHABET; ++symbol)
+        {
+            float d = sax_mindist(paa.segment[level % 3][level / 3], symbol);
+            cost[level][symbol] = d * d;
+        }
+    }
+
+    bool found[TEMPLATE_CAPACITY] = {};
+    float sums[3] = {0.0f, 0.0f, 0.0f};
+    float limit = 2.0f * SAX_SEGMENTS * (1.0f - threshold) * 1.001f + 1e-4f; // slack for the float rounding
+    sax_search(index, 0, 0, cost, sums, limit, found);
+
+    size_t count = 0;
+    for (size_t k = 0; k < index.keys; ++k)
+    {
+        if (found[k])
+        {
+            candidates[count++] = k;
+        }
+    }
+    return count;
+}
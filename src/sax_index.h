@@ -0,0 +1,53 @@
+#ifndef __SAX_INDEX_H
+#define __SAX_INDEX_H
+
+#include "gesture.h"
+
+// Piecewise aggregate approximation (PAA) segments per axis, CANONICAL_LENGTH is a multiple of it
+#define SAX_SEGMENTS 8
+#define SAX_SEGMENT_LENGTH (CANONICAL_LENGTH / SAX_SEGMENTS)
+
+// Symbols per segment, the breakpoints split the standard normal distribution into equally likely regions
+#define SAX_ALPHABET 4
+
+// Trie levels, segment by segment with the three axes interleaved so every axis is pruned early
+#define SAX_DEPTH (3 * SAX_SEGMENTS)
+
+// Every key adds at most one node per level, so the trie never needs more than this
+#define SAX_MAX_NODES (TEMPLATE_CAPACITY * SAX_DEPTH + 1)
+#define SAX_NONE 0xFFFF
+
+// z-normalized PAA of a canonical recording, the mean of each segment in standard deviations
+typedef struct
+{
+    float segment[3][SAX_SEGMENTS];
+} SaxPaa;
+
+// SAX word of a recording, one symbol per segment and axis
+typedef struct
+{
+    uint8_t symbol[3][SAX_SEGMENTS];
+} SaxWord;
+
+// Coarse index of the enrolled keys: a trie over their SAX words
+// A lookup walks the trie with the PAA of the attempt and drops every subtree whose MINDIST
+// on one axis already rules out the correlation threshold. MINDIST is a lower bound of the
+// euclidean distance of the z-normalized recordings, which decides the correlation, so a key
+// that could pass the exact matcher is never dropped. The trie lives in fixed arrays and is
+// rebuilt from the store in O(keys * SAX_DEPTH), e.g. at boot or after the keys changed.
+typedef struct
+{
+    SaxWord words[TEMPLATE_CAPACITY];             // the word of every key
+    uint16_t child[SAX_MAX_NODES][SAX_ALPHABET];  // child per symbol, SAX_NONE if absent; node 0 is the root
+    uint16_t leaf_key[SAX_MAX_NODES];             // first key whose word ends at this leaf
+    uint16_t next_key[TEMPLATE_CAPACITY];         // next key with the same word
+    size_t nodes;                                 // nodes in use
+    size_t keys;                                  // keys indexed
+} SaxIndex;
+
+void sax_paa(SaxPaa &paa, const CanonicalAxes &in);
+void sax_word(SaxWord &word, const SaxPaa &paa);
+void sax_index_build(SaxIndex &index, const TemplateStore &store);
+size_t sax_index_lookup(const SaxIndex &index, const CanonicalAxes &query, float threshold, size_t *candidates);
+
+#endif
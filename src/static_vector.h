@@ -0,0 +1,120 @@
+#ifndef __STATIC_VECTOR_H
+#define __STATIC_VECTOR_H
+
+#include <stddef.h>
+
+// Fixed-capacity vector with inline storage
+// Offers the subset of std::vector used by the recording path without ever touching the heap.
+// push_back on a full vector drops the element and returns false.
+template <typename T, size_t N>
+class StaticVector
+{
+public:
+    typedef T value_type;
+    typedef T *iterator;
+    typedef const T *const_iterator;
+
+    StaticVector() : count(0) {}
+
+    StaticVector(const StaticVector &other) : count(0)
+    {
+        *this = other;
+    }
+
+    // copy only the used part of the storage
+    StaticVector &operator=(const StaticVector &other)
+    {
+        if (this != &other)
+        {
+            for (size_t i = 0; i < other.count; i++)
+            {
+                items[i] = other.items[i];
+            }
+            count = other.count;
+        }
+        return *this;
+    }
+
+    bool push_back(const T &item)
+    {
+        if (count >= N)
+        {
+            return false;
+        }
+        items[count++] = item;
+        return true;
+    }
+
+    // append a slot without copying a temporary into it, nullptr when full
+    // the slot keeps whatever it held before, the caller overwrites it
+    T *append_slot()
+    {
+        if (count >= N)
+        {
+            return nullptr;
+        }
+        return &items[count++];
+    }
+
+    void pop_back()
+    {
+        if (count > 0)
+        {
+            count--;
+        }
+    }
+
+    // shrink, or grow by filling with `value`, up to the capacity
+    void resize(size_t n, const T &value = T())
+    {
+        if (n > N)
+        {
+            n = N;
+        }
+        for (size_t i = count; i < n; i++)
+        {
+            items[i] = value;
+        }
+        count = n;
+    }
+
+    // remove [first, last) and shift the tail to the front
+    iterator erase(iterator first, iterator last)
+    {
+        iterator dst = first;
+        for (iterator src = last; src != end(); ++src, ++dst)
+        {
+            *dst = *src;
+        }
+        count = dst - begin();
+        return first;
+    }
+
+    void clear() { count = 0; }
+
+    size_t size() const { return count; }
+    static constexpr size_t capacity() { return N; }
+    bool empty() const { return count == 0; }
+    bool full() const { return count == N; }
+
+    T *data() { return items; }
+    const T *data() const { return items; }
+
+    iterator begin() { return items; }
+    iterator end() { return items + count; }
+    const_iterator begin() const { return items; }
+    const_iterator end() const { return items + count; }
+
+    T &operator[](size_t i) { return items[i]; }
+    const T &operator[](size_t i) const { return items[i]; }
+    T &front() { return items[0]; }
+    const T &front() const { return items[0]; }
+    T &back() { return items[count - 1]; }
+    const T &back() const { return items[count - 1]; }
+
+private:
+    T items[N];
+    size_t count;
+};
+
+#endif
@@ -0,0 +1,220 @@
+#include <limits>
+#include <cmath>
+#include "template_average.h"
+
+// predecessor of a cell on the DTW path, 2 bits per cell
+#define STEP_DIAGONAL 0 // (i - 1, j - 1)
+#define STEP_UP 1       // (i - 1, j), repetition sample j is also aligned to the previous average sample
+#define STEP_LEFT 2     // (i, j - 1), several repetition samples are aligned to average sample i
+
+float average_rows[2][RECORD_CAPACITY + 1];                        // rolling rows of the alignment cost
+uint8_t average_steps[RECORD_CAPACITY][(AVERAGE_ROW_CELLS + 3) / 4]; // predecessors inside the band, 4 KB
+GestureRecord average_samples;                                     // the rounded average for the key
+GestureRecord average_spread;                                      // its per-sample tolerance
+
+/*******************************************************************************
+ *
+ * @brief Start a new enrollment
+ * @param average: the running average to clear
+ *
+ * ****************************************************************************/
+void template_average_reset(TemplateAverage &average)
+{
+    average.length = 0;
+    average.count = 0;
+}
+
+/*******************************************************************************
+ *
+ * @brief First sample of the band in row i, the same band as dtw()
+ * @param i: the row, 1-based
+ * @param n: samples of the average
+ * @param m: samples of the repetition
+ * @param band: the widened band half width
+ * @return the 1-based column the band starts at
+ *
+ * ****************************************************************************/
+size_t band_start(size_t i, size_t n, size_t m, size_t band)
+{
+    size_t center = i * m / n;
+    return center > band ? center - band : 1;
+}
+
+/*******************************************************************************
+ *
+ * @brief Align one more repetition to the average and fold it in
+ * The banded DTW keeps the predecessor of every cell, the path is traced back from
+ * (n, m) and every average sample is updated with the mean of the repetition samples
+ * on its row of the path. The first repetition becomes the average as it is.
+ * @param average: the running average
+ * @param repetition: the trimmed recording of the next repetition
+ * @param band: half width of the warping window, at most AVERAGE_MAX_BAND
+ * @param threshold: the normalized DTW distance above which the repetition is rejected
+ * @return the normalized DTW distance of the repetition to the average, 0 for the first one;
+ *         the average is left unchanged if it is above the threshold or infinity (empty, band too wide)
+ *
+ * ****************************************************************************/
+float template_average_add(TemplateAverage &average, const GestureRecord &repetition, size_t band, float threshold)
+{
+    const float inf = numeric_limits<float>::infinity();
+    size_t n = average.length;
+    size_t m = repetition.size();
+    if (m == 0)
+    {
+        return inf;
+    }
+
+    if (average.count == 0)
+    {
+        for (size_t i = 0; i < m; ++i)
+        {
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                average.mean[i][axis] = repetition[i][axis];
+                average.m2[i][axis] = 0.0f;
+            }
+        }
+        average.length = m;
+        average.count = 1;
+        return 0.0f;
+    }
+
+    size_t step = m / n + 1;
+    band = max(band, step);
+    if (band > AVERAGE_MAX_BAND)
+    {
+        return inf;
+    }
+
+    float *prev = average_rows[0];
+    float *curr = average_rows[1];
+    prev[0] = 0;
+    for (size_t j = 1; j <= min(m, band + step); ++j)
+    {
+        prev[j] = inf;
+    }
+
+    for (size_t i = 1; i <= n; ++i)
+    {
+        size_t lo = band_start(i, n, m, band);
+        size_t hi = min(m, i * m / n + band);
+        uint8_t *steps = average_steps[i - 1];
+
+        curr[lo - 1] = inf;
+        for (size_t j = lo; j <= hi; ++j)
+        {
+            float cost = 0;
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                float d = average.mean[i - 1][axis] - repetition[j - 1][axis];
+                cost += d * d;
+            }
+
+            // ties go to the diagonal like min() in dtw()
+            float best = prev[j - 1];
+            uint8_t from = STEP_DIAGONAL;
+            if (prev[j] < best)
+            {
+                best = prev[j];
+                from = STEP_UP;
+            }
+            if (curr[j - 1] < best)
+            {
+                best = curr[j - 1];
+                from = STEP_LEFT;
+            }
+            curr[j] = sqrtf(cost) + best;
+
+            size_t cell = j - lo;
+            uint8_t shift = (cell & 3) * 2;
+            steps[cell >> 2] = (steps[cell >> 2] & ~(3 << shift)) | (from << shift);
+        }
+        for (size_t j = hi + 1; j <= min(m, hi + step); ++j)
+        {
+            curr[j] = inf;
+        }
+        swap(prev, curr);
+    }
+
+    float distance = prev[m] / (n + m);
+    if (!(distance <= threshold))
+    {
+        return distance;
+    }
+
+    // trace the path back and update one average sample per row, Welford's update of mean and variance
+    float count = average.count + 1;
+    size_t i = n;
+    size_t j = m;
+    while (i > 0)
+    {
+        float sum[3] = {0.0f, 0.0f, 0.0f};
+        int aligned = 0;
+        size_t row = i;
+        while (i == row && j > 0)
+        {
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                sum[axis] += repetition[j - 1][axis];
+            }
+            aligned++;
+
+            size_t cell = j - band_start(i, n, m, band);
+            uint8_t from = (average_steps[i - 1][cell >> 2] >> ((cell & 3) * 2)) & 3;
+            if (from != STEP_LEFT)
+            {
+                i--;
+            }
+            if (from != STEP_UP)
+            {
+                j--;
+            }
+        }
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            float sample = sum[axis] / aligned;
+            float delta = sample - average.mean[row - 1][axis];
+            average.mean[row - 1][axis] += delta / count;
+            average.m2[row - 1][axis] += delta * (sample - average.mean[row - 1][axis]);
+        }
+    }
+    average.count++;
+    return distance;
+}
+
+/*******************************************************************************
+ *
+ * @brief Enroll the average as a key, with a tolerance of ENROLL_SPREAD_SIGMAS standard deviations
+ * @param store: the template store
+ * @param average: the average of at least one repetition
+ * @param band: the DTW band of the key envelope
+ * @return the index of the new template, -1 if the store is full or the average empty
+ *
+ * ****************************************************************************/
+int add_template_average(TemplateStore &store, const TemplateAverage &average, size_t band)
+{
+    if (average.count == 0)
+    {
+        return -1;
+    }
+
+    average_samples.resize(average.length);
+    average_spread.resize(average.length);
+    for (size_t i = 0; i < average.length; ++i)
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            float mean = roundf(average.mean[i][axis]);
+            average_samples[i][axis] = (int16_t)min(max(mean, (float)INT16_MIN), (float)INT16_MAX);
+
+            float spread = 0.0f;
+            if (average.count > 1)
+            {
+                spread = ENROLL_SPREAD_SIGMAS * sqrtf(average.m2[i][axis] / (average.count - 1));
+            }
+            average_spread[i][axis] = (int16_t)min(roundf(spread), (float)INT16_MAX);
+        }
+    }
+    return add_template(store, average_samples, band, average.count > 1 ? &average_spread : nullptr);
+}
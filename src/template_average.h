@@ -0,0 +1,30 @@
+#ifndef __TEMPLATE_AVERAGE_H
+#define __TEMPLATE_AVERAGE_H
+
+#include "gesture.h"
+
+// Half width of the tolerance around each sample of an averaged key, in standard deviations of the repetitions
+#define ENROLL_SPREAD_SIGMAS 2.0f
+
+// Widest DTW band the alignment can trace back, 2 * band + 1 cells per row
+#define AVERAGE_MAX_BAND (RECORD_CAPACITY / 8)
+#define AVERAGE_ROW_CELLS (2 * AVERAGE_MAX_BAND + 1)
+
+// Incremental DTW barycenter averaging (DBA) of the enrollment repetitions
+// Every repetition is aligned to the current average with the banded DTW, then each sample
+// of the average moves towards the mean of the repetition samples aligned to it. Only the
+// average and the per-sample variance (Welford) are kept, never the repetitions themselves,
+// so the working set stays the same for any number of repetitions.
+typedef struct
+{
+    float mean[RECORD_CAPACITY][3]; // the average, same length as the first repetition
+    float m2[RECORD_CAPACITY][3];   // sum of squared deviations of the aligned samples from the mean
+    size_t length;                  // samples of the average
+    uint16_t count;                 // repetitions averaged so far
+} TemplateAverage;
+
+void template_average_reset(TemplateAverage &average);
+float template_average_add(TemplateAverage &average, const GestureRecord &repetition, size_t band, float threshold);
+int add_template_average(TemplateStore &store, const TemplateAverage &average, size_t band);
+
+#endif